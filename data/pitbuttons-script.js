@@ -4,6 +4,16 @@ const keepAliveInterval = 10000; // 10 seconds
 // Global variable to track mute state
 let isMuted = false;
 
+// Lane countdowns arrive once, as deadlines on the device's millis() clock,
+// and are ticked down here. deviceOffset maps device time to Date.now().
+const laneDeadlines = [null, null, null, null];
+let deviceOffset = null;        // from the clockSync exchange (lowest round trip wins)
+let updateOffset = 0;           // rough offset from the last update, until then
+const clockSamples = [];
+
+// Offline cache for the page assets (see sw.js; https or localhost only)
+if ('serviceWorker' in navigator && window.isSecureContext) navigator.serviceWorker.register('/sw.js').catch(() => {});
+
 
 // Javascript to handle section collapsing
 var coll = document.getElementsByClassName("collapsible");
@@ -27,6 +37,7 @@ window.onload = function(event) {
     console.log('onload');
     initWebSocket();
     setInterval(keepAlive, keepAliveInterval); // Check WebSocket connection every 10 seconds
+    setInterval(renderCountdowns, 250); // tick the lane countdowns locally
 }
 
 function initWebSocket() {
@@ -34,8 +45,14 @@ function initWebSocket() {
     websocket.onopen = function(event) { 
         console.log('Connected to WebSocket'); 
         updateConnectionStatus(true);
+        // the device may have rebooted, so its clock starts over: forget the old offset
+        clockSamples.length = 0;
+        deviceOffset = null;
+        // only lane and team updates; weights are for the scale page
+        websocket.send(JSON.stringify({ type: 'subscribe', topics: ['lanes', 'teams'], t: Date.now() }));
         getTeamNames(); // Call the function to get team names from the websocket
         getCountdownTimer(); // get the current value of the countdown slider
+        sendClockSync(); // learn the device clock for the lane countdowns
         loadCustomAnnouncements(); // Call the function to load announcements
     };
     websocket.onclose = function(event) { 
@@ -44,6 +61,7 @@ function initWebSocket() {
         setTimeout(initWebSocket, timeout); // Attempt to reconnect after 5 seconds
     };
     websocket.onmessage = function(event) {
+        if (typeof event.data !== 'string') return; // binary weight frames (before subscribe takes effect)
         try {
             handleWebSocketMessage(JSON.parse(event.data));
         } catch (e) {
@@ -60,6 +78,48 @@ function keepAlive() {
     if (!websocket || websocket.readyState === WebSocket.CLOSED) {
         console.log('WebSocket is closed, attempting to reconnect...');
         initWebSocket();
+    } else if (websocket.readyState === WebSocket.OPEN) {
+        sendClockSync(); // keep the clock offset fresh
+    }
+}
+
+function sendClockSync() {
+    websocket.send(JSON.stringify({ type: 'clockSync', t: Date.now() }));
+}
+
+// NTP-style: the device's time was read about half a round trip after we
+// sent ours. Keep the last few samples and trust the fastest one.
+function handleClockSync(message) {
+    const rtt = Date.now() - message.t;
+    clockSamples.push({ rtt: rtt, offset: message.t + rtt / 2 - message.now });
+    if (clockSamples.length > 8) clockSamples.shift();
+    deviceOffset = clockSamples.reduce((best, s) => (s.rtt < best.rtt ? s : best)).offset;
+}
+
+// Seconds left on a lane's countdown, from its deadline and the clock offset
+function laneRemaining(lane) {
+    const deadline = laneDeadlines[lane];
+    if (deadline === null) return 0;
+    const offset = deviceOffset !== null ? deviceOffset : updateOffset;
+    return Math.max(0, Math.ceil((deadline + offset - Date.now()) / 1000));
+}
+
+function renderCountdowns() {
+    for (let lane = 0; lane < laneDeadlines.length; lane++) {
+        const teamBox = document.getElementById('team' + (lane + 1));
+        const button = document.getElementById('pilotSwapButton' + (lane + 1));
+        if (!teamBox || !button) continue;
+        const remaining = laneRemaining(lane);
+        if (remaining > 0) {
+            button.disabled = true;
+            button.textContent = 'Announce (' + remaining + ')';
+            teamBox.style.backgroundColor = 'yellow';
+        } else {
+            if (laneDeadlines[lane] !== null) laneDeadlines[lane] = null;
+            button.disabled = false;
+            button.textContent = 'Announce';
+            teamBox.style.backgroundColor = '';
+        }
     }
 }
 
@@ -67,6 +127,7 @@ function keepAlive() {
 function handleWebSocketMessage(message) {
     if (message.type === 'update') {
         // console.log('handle JS Websocket update: ', message);
+        if (typeof message.now === 'number') updateOffset = Date.now() - message.now;
         updateTeamsUI(message.data);
     }  else if (message.type === 'pilotSwap') {
        // console.log('handle JS Websocket pilotSwap: ', message);
@@ -79,9 +140,23 @@ function handleWebSocketMessage(message) {
     } else if (message.type === 'updateTeamNames') {
         // Load team names
         //console.log('Loading team names from message:', message.teamNames); // Add debugging information
+        storeTeamRoster(message.version, message.teamNames);
         loadTeamNames(message.teamNames);
+    } else if (message.type === 'teamNamesCurrent') {
+        // our cached roster is the device's current one
+        const roster = cachedTeamRoster();
+        if (roster) loadTeamNames(roster.teamNames); else getTeamNames(true);
+    } else if (message.type === 'teamNamesVersion') {
+        // the roster was changed from some page; fetch it if ours is older
+        const roster = cachedTeamRoster();
+        if (!roster || roster.version !== message.version) getTeamNames();
     } else if  (message.type === 'timerUpdate') {
         updateCountdownDisplay(message.timerValue);
+    } else if (message.type === 'clockSync') {
+        handleClockSync(message);
+    } else if (message.type === 'saved') {
+        // the device acks team names / timer once they are on flash
+        if (!message.ok) alert('The device could not save the ' + message.item + ' setting');
     } else {
         console.log('Unknown WebSocket message type:', message.type);
     }
@@ -97,24 +172,13 @@ function updateTeamName(selectElement, teamId) {
     websocket.send(JSON.stringify({ type: 'update', teamId: teamId, teamName: selectedTeamName })); // Ensure correct data format
 }
 
-// takes single team update with name, id, countdown and buttonId.
-// sends or returns nothing. 
-function updateTeamBox(teamName, teamId, countdown, buttonId) {
-    // console.log('updateTeamBox: ', teamId, " -> ", teamName, countdown, buttonId);
+// takes single team update with name, id and the lane's countdown deadline
+// (device clock, null = none). The countdown itself is drawn by renderCountdowns.
+function updateTeamBox(teamName, teamId, deadline) {
+    // console.log('updateTeamBox: ', teamId, " -> ", teamName, deadline);
     document.querySelector(`#${teamId} .team-name`).textContent = teamName;
-
-    const teamBox = document.getElementById(teamId);
-    const button = document.getElementById(buttonId);
-    if (countdown > 0) {
-        // console.log('Disable the button');
-        button.disabled = true;
-        teamBox.style.backgroundColor = 'yellow';
-    } else {
-        // console.log('Enable the button');
-        button.disabled = false;
-        teamBox.style.backgroundColor = '';
-    }
-
+    laneDeadlines[parseInt(teamId.substring(4), 10) - 1] = deadline;
+    renderCountdowns();
 }
 
 // takes teamId as arguments for a single lane update.
@@ -196,11 +260,10 @@ function loadCustomAnnouncements() {
 function updateTeamsUI(UIdata) {
     for (var i = 0; i < UIdata.length; i++) {
         const teamName = UIdata[i].teamName;
-        const countdown = UIdata[i].countdown;
+        const deadline = (typeof UIdata[i].deadline === 'number') ? UIdata[i].deadline : null;
         const teamId = 'team' + (i + 1);
-        const buttonId = 'pilotSwapButton' + (i + 1);
 
-        updateTeamBox(teamName, teamId, countdown, buttonId);
+        updateTeamBox(teamName, teamId, deadline);
     }
 }
 
@@ -219,8 +282,31 @@ function updateConnectionStatus(isConnected) {
 }
 
 // Team Names Table Functions
-function getTeamNames() {
-    websocket.send(JSON.stringify({ type: 'getTeamNames' }));
+// The roster is cached in localStorage with the device's version number, so
+// a reconnect only downloads it when it has changed
+function cachedTeamRoster() {
+    try {
+        const roster = JSON.parse(localStorage.getItem('teamRoster'));
+        return roster && typeof roster.version === 'number' && Array.isArray(roster.teamNames) ? roster : null;
+    } catch (e) {
+        return null;
+    }
+}
+
+function storeTeamRoster(version, teamNames) {
+    if (typeof version !== 'number') return;
+    try {
+        localStorage.setItem('teamRoster', JSON.stringify({ version: version, teamNames: teamNames }));
+    } catch (e) {
+        console.log('Could not cache the team roster:', e);
+    }
+}
+
+function getTeamNames(ignoreCache) {
+    const roster = ignoreCache ? null : cachedTeamRoster();
+    const request = { type: 'getTeamNames' };
+    if (roster) request.version = roster.version;
+    websocket.send(JSON.stringify(request));
 }
 
 // Team names table and functions
@@ -279,8 +365,9 @@ function loadTeamNames(TeamNamesList) {
 function saveTeamNames() {
     const teamNames = Array.from(document.querySelectorAll('#teamNamesTable tbody tr td:nth-child(2)')).map(td => td.textContent);
     // Send the team names to the websocket to be saved
+    // the device answers every team page with the new version, which
+    // makes this one reload the list too
     websocket.send(JSON.stringify({ type: 'updateTeamNames', teamNames: teamNames }));
-    getTeamNames(); // Reload the team names after saving
 }
 
 function addTeamName() {
@@ -3,6 +3,10 @@
   const timeSpan = document.getElementById('timeSpan');
   const tareAllBtn = document.getElementById('tareAllBtn');
 
+  // Offline cache for the page assets (browsers only allow service workers
+  // on https or localhost; elsewhere the HTTP cache and ETags do the work)
+  if ('serviceWorker' in navigator && window.isSecureContext) navigator.serviceWorker.register('/sw.js').catch(() => {});
+
 
   // The UI will only display graphs for nodes that send data via ESP-NOW.
 
@@ -76,7 +80,7 @@
       document.body.prepend(card);
     }
 
-    const g = { container: card, canvas, ctx: canvas.getContext('2d'), data: [], lastSeen: Date.now(), name: nameInput.value || serverName || ('Node ' + id), color: colorInput.value, weightEl, titleEl: title, nameInput, colorInput, editBtn, saveBtn, cancelBtn };
+    const g = { container: card, canvas, ctx: canvas.getContext('2d'), data: [], lastSeen: Date.now(), name: nameInput.value || serverName || ('Node ' + id), color: colorInput.value, weightEl, titleEl: title, nameInput, colorInput, editBtn, saveBtn, cancelBtn, tareBtn };
     // initial value
     if (firstValue !== undefined && !isNaN(firstValue)) g.data.push({ t: Date.now(), v: Number(firstValue) });
 
@@ -158,45 +162,145 @@
     persistChildSettings();
   }
 
-  function processChildren(obj) {
-    if (!obj || !obj.children) return;
-    // Debug: show which child keys arrived
-    // try { console.log('processChildren keys:', Object.keys(obj.children)); } catch (e) {}
-    const now = Date.now();
-    // Support two formats: array of {id,weight,name} (server) or object map id->{weight,name}
-    if (Array.isArray(obj.children)) {
-      obj.children.forEach(entry => {
-        if (!entry) return;
-        const k = String(entry.id || '');
-        const val = (entry.weight === undefined) ? NaN : entry.weight;
-        const serverName = entry.name;
-        const g = createChildGraph(k, val, serverName);
-        if (val === null || val === undefined || isNaN(val)) g.data.push({ t: now, v: NaN }); else { g.data.push({ t: now, v: Number(val) }); g.lastSeen = now; }
-        const cutoff = now - WINDOW_MS; while (g.data.length && g.data[0].t < cutoff) g.data.shift();
-      });
-      return;
+  // Append full-resolution samples [millis, weight] from batch frames.
+  // Samples from a time-synced node are on the parent's clock, so one offset
+  // (parent "now" vs browser now) places every node on the same time axis.
+  // Otherwise child timestamps get a per-graph offset, anchored so the
+  // newest sample lands at "now".
+  function pushSamples(g, samples, now, parentNow) {
+    if (parentNow !== undefined) {
+      g.clockOffset = now - parentNow;
+    } else {
+      const lastT = Number(samples[samples.length - 1][0]);
+      const offset = now - lastT;
+      if (g.clockOffset === undefined || Math.abs(offset - g.clockOffset) > 2000) g.clockOffset = offset;
+      else g.clockOffset = Math.min(g.clockOffset, offset);
     }
-    Object.keys(obj.children).forEach(k => {
-      const entry = obj.children[k];
-      let val = undefined;
-      let serverName = undefined;
-      if (entry !== null && typeof entry === 'object') {
-        val = entry.weight;
-        serverName = entry.name;
-      } else {
-        val = entry;
+    samples.forEach(p => {
+      const v = Number(p[1]);
+      g.data.push({ t: Number(p[0]) + g.clockOffset, v: isNaN(v) ? NaN : v });
+    });
+    g.lastSeen = now;
+  }
+
+  // Decode a binary weight frame (see include/weight-frame.h) into
+  // { mode, now, children: [{id, weight, settled, online, synced, rssi, latency, loss, battery, name, samples}] }
+  const WEIGHT_FRAME_MAGIC = 0x57;
+  const WEIGHT_FRAME_VERSION = 2;  // newest layout this page reads; keep in step with weight-frame.h
+  const BATTERY_LOW_SOC = 20;  // keep in step with config.h
+  const WF_ONLINE = 0x01, WF_HAS_WEIGHT = 0x02, WF_HAS_SETTLED = 0x04, WF_SYNCED = 0x08, WF_HAS_RSSI = 0x10, WF_HAS_LATENCY = 0x20, WF_HAS_VERDICT = 0x40, WF_PASS = 0x80;
+  const nameDecoder = new TextDecoder();
+  function decodeWeightFrame(buf) {
+    const dv = new DataView(buf);
+    if (dv.byteLength < 7 || dv.getUint8(0) !== WEIGHT_FRAME_MAGIC) return null;
+    const version = dv.getUint8(1);
+    if (version < 1 || version > WEIGHT_FRAME_VERSION) return null;  // a layout this page can't walk
+    let o = 2;
+    const now = dv.getUint32(o, true); o += 4;
+    const count = dv.getUint8(o); o += 1;
+    const children = [];
+    for (let i = 0; i < count; i++) {
+      const id = dv.getUint8(o); const flags = dv.getUint8(o + 1); o += 2;
+      const entry = { id: id, online: !!(flags & WF_ONLINE), synced: !!(flags & WF_SYNCED), weight: null };
+      if (flags & WF_HAS_WEIGHT) { entry.weight = dv.getInt32(o, true) / 100; o += 4; }
+      if (flags & WF_HAS_SETTLED) { entry.settled = dv.getInt32(o, true) / 100; o += 4; }
+      if (flags & WF_HAS_VERDICT) entry.pass = !!(flags & WF_PASS);
+      if (flags & WF_HAS_RSSI) { entry.rssi = dv.getInt8(o); o += 1; }
+      if (flags & WF_HAS_LATENCY) { entry.latency = dv.getUint16(o, true); o += 2; }
+      entry.loss = dv.getUint16(o, true); o += 2;
+      if (version >= 2) {
+        // percent, 0xFE = external power, 0xFF = not reported
+        const battery = dv.getUint8(o); o += 1;
+        entry.battery = battery === 0xFF ? null : battery === 0xFE ? 'usb' : battery;
       }
-      const g = createChildGraph(k, val, serverName);
-      // update data
-      if (val === null || val === undefined || isNaN(val)) {
-        g.data.push({ t: now, v: NaN });
-      } else {
-        g.data.push({ t: now, v: Number(val) });
-        g.lastSeen = now;
+      const nameLen = dv.getUint8(o); o += 1;
+      if (nameLen) entry.name = nameDecoder.decode(new Uint8Array(buf, o, nameLen));
+      o += nameLen;
+      const n = dv.getUint16(o, true); o += 2;
+      if (n) {
+        const base = dv.getUint32(o, true); o += 4;
+        entry.samples = new Array(n);
+        for (let k = 0; k < n; k++) {
+          entry.samples[k] = [base + dv.getUint16(o, true), dv.getInt32(o + 2, true) / 100];
+          o += 6;
+        }
       }
-      // trim to window
-      const cutoff = now - WINDOW_MS;
-      while (g.data.length && g.data[0].t < cutoff) g.data.shift();
+      children.push(entry);
+    }
+    return { mode: 'parent', now: now, children: children };
+  }
+
+  // Decode GET /api/history (see include/history.h) into
+  // { now, step, nodes: [{id, name, points: [[parentMs, weight|NaN], ...]}] }
+  const HISTORY_MAGIC = 0x48;
+  const HISTORY_GAP = -2147483648;
+  function decodeHistory(buf) {
+    const dv = new DataView(buf);
+    if (dv.byteLength < 8 || dv.getUint8(0) !== HISTORY_MAGIC) return null;
+    const now = dv.getUint32(2, true);
+    const step = dv.getUint16(6, true);
+    const nodes = [];
+    let o = 8;
+    while (o + 2 <= dv.byteLength) {
+      const id = dv.getUint8(o); const nameLen = dv.getUint8(o + 1); o += 2;
+      const name = nameLen ? nameDecoder.decode(new Uint8Array(buf, o, nameLen)) : undefined;
+      o += nameLen;
+      const newest = dv.getUint32(o, true); const n = dv.getUint16(o + 4, true); o += 6;
+      const points = [];
+      for (let k = 0; k < n; k++) {
+        const w = dv.getInt32(o, true); o += 4;
+        points.push([newest - (n - 1 - k) * step, w === HISTORY_GAP ? NaN : w / 100]);
+      }
+      nodes.push({ id: id, name: name, points: points });
+    }
+    return { now: now, step: step, nodes: nodes };
+  }
+
+  // Backfill the graphs with the parent's history so a freshly opened page
+  // shows the whole window; live points already drawn are kept as they are
+  function loadHistory() {
+    fetch('/api/history').then(r => r.ok ? r.arrayBuffer() : null).then(buf => {
+      const hist = buf && decodeHistory(buf);
+      if (!hist) return;
+      const now = Date.now();
+      const offset = now - hist.now;  // parent ms -> browser ms
+      hist.nodes.forEach(node => {
+        const points = node.points.filter(p => !isNaN(p[1]));
+        if (!points.length) return;
+        const g = createChildGraph(String(node.id), undefined, node.name);
+        const firstLive = g.data.length ? g.data[0].t : Infinity;
+        const cutoff = now - WINDOW_MS;
+        const older = node.points
+          .map(p => ({ t: p[0] + offset, v: p[1] }))
+          .filter(p => p.t >= cutoff && p.t < firstLive);
+        g.data = older.concat(g.data);
+      });
+      drawAll();
+    }).catch(e => console.error('History load failed', e));
+  }
+
+  function processChildren(obj) {
+    if (!obj || !Array.isArray(obj.children)) return;
+    const now = Date.now();
+    obj.children.forEach(entry => {
+      if (!entry) return;
+      const k = String(entry.id || '');
+      const val = (entry.weight === undefined) ? NaN : entry.weight;
+      const serverName = entry.name;
+      const g = createChildGraph(k, val, serverName);
+      if (Array.isArray(entry.samples) && entry.samples.length) {
+        pushSamples(g, entry.samples, now, (entry.synced && obj.now !== undefined) ? Number(obj.now) : undefined);
+      } else if (val === null || val === undefined || isNaN(val)) g.data.push({ t: now, v: NaN }); else { g.data.push({ t: now, v: Number(val) }); g.lastSeen = now; }
+      g.settled = (entry.settled === undefined || entry.settled === null) ? NaN : Number(entry.settled);
+      // verdict from the node against its spec class (undefined = no spec)
+      g.pass = (typeof entry.pass === 'boolean') ? entry.pass : undefined;
+      // link health from the parent's node registry
+      g.online = entry.online !== false;
+      g.rssi = (entry.rssi === undefined || entry.rssi === null) ? null : Number(entry.rssi);
+      g.loss = Number(entry.loss) || 0;
+      g.latency = (entry.latency === undefined) ? null : Number(entry.latency);
+      g.battery = (entry.battery === undefined) ? null : entry.battery;
+      const cutoff = now - WINDOW_MS; while (g.data.length && g.data[0].t < cutoff) g.data.shift();
     });
   }
 
@@ -217,11 +321,31 @@
   let MIN_SPEC = (specInputEl && parseFloat(specInputEl.value)) || (specInputEl && parseFloat(specInputEl.placeholder)) || 550;
   if (loadSpecBtn && specInputEl) loadSpecBtn.addEventListener('click', () => {
     const v = parseFloat(specInputEl.value);
-    if (!isNaN(v)) { MIN_SPEC = v; setStatus('Spec set: ' + MIN_SPEC + ' g'); }
+    if (!isNaN(v)) {
+      MIN_SPEC = v;
+      setStatus('Spec set: ' + MIN_SPEC + ' g');
+      // the spec is the minimum of the first class; the nodes judge their
+      // settled weights against it and the parent logs the verdicts
+      fetch('/api/spec').then(r => r.json()).then(spec => {
+        const classes = (spec && Array.isArray(spec.classes) && spec.classes.length) ? spec.classes : [{ name: 'Default' }];
+        classes[0].min = v;
+        return fetch('/api/spec', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify({ classes: classes }) });
+      }).then(r => { if (!r.ok) throw new Error(); }).catch(() => setStatus('Spec not saved on device'));
+    }
     else setStatus('Invalid spec');
     updateSpecTable();
   });
 
+  // Start from the spec saved on the device, if any
+  fetch('/api/spec').then(r => r.json()).then(spec => {
+    const first = spec && Array.isArray(spec.classes) ? spec.classes[0] : null;
+    if (first && typeof first.min === 'number') {
+      MIN_SPEC = first.min;
+      if (specInputEl) specInputEl.value = first.min;
+      drawAll();
+    }
+  }).catch(() => {});
+
   // Pressing Enter in the spec input should trigger the Set Spec button
   if (specInputEl && loadSpecBtn) {
     specInputEl.addEventListener('keydown', (ev) => {
@@ -248,12 +372,19 @@
     const protocol = (loc.protocol === 'https:') ? 'wss://' : 'ws://';
     const url = protocol + loc.host + '/ws';
     ws = new WebSocket(url);
-    ws.onopen = () => setStatus('WS connected');
+    ws.binaryType = 'arraybuffer';  // live weights arrive as binary frames
+    ws.onopen = () => {
+      setStatus('WS connected');
+      ws.send(JSON.stringify({ type: 'subscribe', topics: ['weights'], t: Date.now() }));
+      loadHistory();
+    };
     // no local scales to initialize; dynamic graphs will appear as data arrives
     ws.onclose = () => { setStatus('WS disconnected — retrying'); setTimeout(connect, 1500); };
     ws.onmessage = (ev) => {
       try {
-        const obj = JSON.parse(ev.data);
+        const obj = (typeof ev.data === 'string') ? JSON.parse(ev.data) : decodeWeightFrame(ev.data);
+        if (!obj) return;
+        if (obj.type === 'cmdResult') { showCommandResult(obj); return; }
         // Check if parent or child mode
         if (obj.mode === 'parent') {
           isParentMode = true;
@@ -274,11 +405,23 @@
   }
   connect();
 
+  // Per-node outcome of a reliable command sent by the parent
+  function showCommandResult(res) {
+    const label = (res.cmd === 'tare' ? 'Tare' : res.cmd) + ' ' + res.node;
+    setStatus(res.ok ? (label + ' OK (' + res.rtt + ' ms)') : (label + ' failed after ' + res.attempts + ' tries'));
+    const g = childGraphs.get(String(res.node));
+    if (g && g.tareBtn) {
+      g.tareBtn.textContent = res.ok ? 'Tared \u2713' : 'Tare \u2717';
+      g.tareBtn.title = res.ok ? ('Acknowledged in ' + res.rtt + ' ms') : 'No response from node';
+      setTimeout(() => { g.tareBtn.textContent = 'Tare'; }, 2000);
+    }
+  }
+
   // Modular tare function - sends tare request for a specific node
   function sendTareCommand(nodeId) {
     if (ws && ws.readyState === WebSocket.OPEN) {
       ws.send('tare:' + nodeId);
-      setStatus('Tare ' + nodeId + ' sent');
+      setStatus('Tare ' + nodeId + ' pending...');
       return;
     }
     // Fallback to HTTP endpoint (for child nodes only)
@@ -291,11 +434,9 @@
   // Tare all nodes - send requests to all connected child nodes
   tareAllBtn.addEventListener('click', () => {
     if (ws && ws.readyState === WebSocket.OPEN) {
-      // Parent mode: loop through all possible child nodes
-      for (let i = 1; i <= 10; i++) {
-        ws.send('tare:' + i);
-      }
-      setStatus('Tare all sent');
+      // Parent mode: parent tares every child it knows; results arrive per node
+      ws.send('tare');
+      setStatus('Tare all pending...');
       return;
     }
     // Child mode or WS unavailable: use HTTP endpoint
@@ -385,11 +526,23 @@
       drawGraph(g.canvas, g.ctx, g.data, g.color || '#0077cc');
       try {
         const titleEl = g.titleEl || g.container.querySelector('.dgTitleRow div');
-        if (titleEl) titleEl.textContent = (g.name || ('Node ' + id));
+        if (titleEl) {
+          let title = (g.name || ('Node ' + id));
+          if (g.online === false) title += ' (offline)';
+          else if (g.rssi !== null && g.rssi !== undefined) title += ' \u00b7 ' + g.rssi + ' dBm' + (g.loss ? ' \u00b7 ' + g.loss + ' lost' : '');
+          if (g.online !== false && g.latency !== null && g.latency !== undefined) title += ' \u00b7 ' + g.latency + ' ms old';
+          if (typeof g.battery === 'number') title += ' \u00b7 ' + g.battery + '%' + (g.battery <= BATTERY_LOW_SOC ? ' swap battery' : '');
+          titleEl.textContent = title;
+        }
+        g.container.style.opacity = (g.online === false) ? '0.5' : '';
         // update current weight display
         const last = g.data.length ? g.data[g.data.length - 1] : null;
         if (g.weightEl) {
-          g.weightEl.textContent = (last && !isNaN(last.v)) ? (last.v.toFixed(1) + ' g') : '-- g';
+          if (g.settled !== undefined && !isNaN(g.settled)) {
+            const verdict = (g.pass === true) ? ' PASS' : (g.pass === false) ? ' FAIL' : ' \u2713';
+            g.weightEl.textContent = g.settled.toFixed(1) + ' g' + verdict;
+          }
+          else g.weightEl.textContent = (last && !isNaN(last.v)) ? (last.v.toFixed(1) + ' g') : '-- g';
         }
       } catch (e) {}
     });
@@ -0,0 +1,57 @@
+// sw.js
+// Service worker: pages and scripts come from the network (the parent
+// replies 304 when nothing changed) and from the cache only when the
+// device can't be reached, so a reflashed page is never one visit behind.
+// Styles and images are answered from the cache and refreshed in the
+// background. Live data (/ws, /api, /settings, ...) always goes to the
+// network.
+const CACHE = 'scale-assets-v2';
+const ASSETS = ['/', '/scale-script.js', '/scale-style.css', '/favicon.png',
+  '/pitbuttons', '/pitbuttons-script.js', '/pitbuttons-style.css'];
+
+function isAsset(url) {
+  if (url.origin !== self.location.origin) return false;
+  return isPage(url) || /\.(css|png|svg|ico)$/.test(url.pathname);
+}
+
+function isPage(url) {
+  return url.pathname === '/' || url.pathname === '/pitbuttons' || /\.(html|js)$/.test(url.pathname);
+}
+
+self.addEventListener('install', (event) => {
+  // a missing asset must not stop the worker from installing
+  event.waitUntil(caches.open(CACHE)
+    .then(cache => Promise.all(ASSETS.map(url => cache.add(url).catch(() => {}))))
+    .then(() => self.skipWaiting()));
+});
+
+self.addEventListener('activate', (event) => {
+  event.waitUntil(caches.keys()
+    .then(keys => Promise.all(keys.filter(k => k !== CACHE).map(k => caches.delete(k))))
+    .then(() => self.clients.claim()));
+});
+
+self.addEventListener('fetch', (event) => {
+  const request = event.request;
+  const url = new URL(request.url);
+  if (request.method !== 'GET' || !isAsset(url)) return;
+  if (isPage(url)) {
+    // network first; the cached copy is only for when the device is offline
+    event.respondWith(caches.open(CACHE).then(cache => fetch(request, { cache: 'no-cache' })
+      .then(response => {
+        if (response.ok) event.waitUntil(cache.put(request, response.clone()));
+        return response;
+      })
+      .catch(() => cache.match(request).then(cached => cached || Response.error()))));
+    return;
+  }
+  event.respondWith(caches.open(CACHE).then(cache => cache.match(request).then(cached => {
+    const refresh = fetch(request, { cache: 'no-cache' }).then(response => {
+      if (response.ok) cache.put(request, response.clone());
+      return response;
+    });
+    if (!cached) return refresh;
+    event.waitUntil(refresh.catch(() => {}));
+    return cached;
+  })));
+});
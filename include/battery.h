@@ -1,10 +1,37 @@
-// Header file for battery measurement functions
+// battery.h
+// Battery monitor. A background task samples VBAT in bursts in the ADC's
+// continuous/DMA mode (the analogContinuous API on Arduino core 3, the IDF
+// adc_digi driver on core 2), smooths it and
+// turns it into a state of charge from a LiPo discharge curve, plus an
+// estimate of the time left from the recent drain rate. loop() and the
+// display only read the results, so they never wait on the ADC.
 #ifndef BATTERY_H
 #define BATTERY_H
 
-float readVBAT();   
+#include <Arduino.h>
+
+#define BATTERY_SOC_EXTERNAL -1         // on USB / external power
+#define BATTERY_MINUTES_UNKNOWN 0xFFFF  // drain rate not known yet
+
+struct BatteryStatus {
+  float voltage;          // smoothed, volts at the battery
+  int8_t soc;             // percent, or BATTERY_SOC_EXTERNAL
+  uint16_t minutesLeft;   // or BATTERY_MINUTES_UNKNOWN
+};
+
+// Take a first reading and start the sampling task (early in setup())
+void batteryInit();
+
+BatteryStatus batteryStatus();
+
+// State of charge (0-100) for a resting cell voltage, or
+// BATTERY_SOC_EXTERNAL if the voltage says it is on external power
+int batterySocForVoltage(float voltage);
+
+// Blocking one-shot read of the battery voltage in volts
+float readVBAT();
 // Reads and returns the battery voltage in volts
 
 float readAveragedMilliVolts(int pin, int samples);
 
-#endif  // BATTERY_H
\ No newline at end of file
+#endif  // BATTERY_H
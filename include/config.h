@@ -5,6 +5,7 @@
 #define CONFIG_H
 
 #include "secrets.h"
+#include "identity.h"
 
 // blah blah blah
 // Global battery voltage variable
@@ -45,42 +46,187 @@ constexpr int KNOWN_SSID_COUNT = sizeof(KNOWN_SSID) / sizeof(KNOWN_SSID[0]);
 
 #define ADC_RESOLUTION 4095.0  // 12-bit ADC
 
-// ESP-NOW Configuration
-// Set to 0 for parent node (receives data), 1-4 for child nodes (sends data)
-#define DEVICE_ID 0
-
-#if DEVICE_ID == 0  // Parent node ID
-  #define ESPNOW_IS_PARENT 1
-  #define HOSTNAME "LaunchScale"
-  #define CALIBRATION_FACTOR 0
-
-#elif DEVICE_ID == 1 // First Child node ID
-  #define ESPNOW_IS_PARENT 0
-  #define HOSTNAME "Yellow"
-  #define CALIBRATION_FACTOR 2128.66
-#elif DEVICE_ID == 2 // Second Child node ID
-  #define ESPNOW_IS_PARENT 0
-  #define HOSTNAME "Grey"
-  #define CALIBRATION_FACTOR 1979.4
-#elif DEVICE_ID == 3 // Third Child node ID
-  #define ESPNOW_IS_PARENT 0
-  #define HOSTNAME "Purple"
-  #define CALIBRATION_FACTOR 2000
-#elif DEVICE_ID == 4 // Fourth Child node ID
-  #define ESPNOW_IS_PARENT 0
-  #define HOSTNAME "Black"
-  #define CALIBRATION_FACTOR 1106.69
-#else 
-    #error "Invalid DEVICE_ID specified."
-#endif
+// Node identity
+// Role, node ID, name, calibration and filter profile live in NVS (see
+// identity.h) so every scale runs the same image. These are the values an
+// unprovisioned node boots with: a child that pairs with whatever parent
+// answers. Provision a parent once over serial with "role parent", and each
+// child with "name" and "cal" (see "help").
+//
+// Scales set up with the old DEVICE_ID builds can be migrated by flashing
+// once with build_flags = -DIDENTITY_SEED_ID=n (0 = parent LaunchScale,
+// 1 Yellow, 2 Grey, 3 Purple, 4 Black): on a node with no identity in NVS
+// yet, that profile's role, ID, name, calibration and filter are stored on
+// first boot. A node that already has an identity is left alone.
+#define IDENTITY_DEFAULT_PARENT 0
+#define IDENTITY_DEFAULT_PARENT_NAME "LaunchScale"
+#define IDENTITY_DEFAULT_CALIBRATION 2000.0f
+
+// Filter chains applied to raw HX711 counts (stages from filters.h).
+// Each child picks one by number with the "filter" serial command.
+#define SCALE_FILTER_PROFILE_0 MedianFilter<5>, MovingAverage<8>               // default
+#define SCALE_FILTER_PROFILE_1 MedianFilter<3>, IirFilter<3>                   // fast response
+#define SCALE_FILTER_PROFILE_2 MedianFilter<5>, MovingAverage<4>, IirFilter<2> // noisy cells
+#define SCALE_FILTER_PROFILES 3
 
 // Tare button pin
-#ifdef ESPNOW_IS_PARENT
-  #define TARE_BUTTON_PIN 14 // normal scale pin 15. Parent 14 because 15 is broken on my ESP32
-#else
-  #define TARE_BUTTON_PIN 15 // normal scale pin 15. Parent 17 because broken
-#endif
+#define PARENT_TARE_BUTTON_PIN 14 // Parent 14 because 15 is broken on my ESP32
+#define CHILD_TARE_BUTTON_PIN 15  // normal scale pin 15
+#define TARE_BUTTON_PIN (identityIsParent() ? PARENT_TARE_BUTTON_PIN : CHILD_TARE_BUTTON_PIN)
 
 // Data transmission interval
 #define CHILD_NODE_INTERVAL 1000  // ms between scale readings on child
-#define ESPNOW_CHANNEL 6 // WiFi channel for ESP-NOW communication  
+#define ESPNOW_CHANNEL 6 // first channel a child tries when it has never paired
+
+// HX711 acquisition task
+#define SCALE_TASK_CORE 0        // core for the HX711 reader (loop() runs on core 1)
+#define SCALE_TASK_PRIORITY 5
+#define SCALE_TASK_STACK 3072
+#define SCALE_RING_SIZE 128      // samples buffered between task and loop (power of two)
+
+// Settled-weight detector (child nodes)
+#define STABILITY_WINDOW 16          // samples in the variance window (~200 ms at 80 Hz)
+#define STABILITY_MAX_VARIANCE 0.25f // g^2 - window must be quieter than this to count as still
+#define STABILITY_HOLD_MS 250        // ms the window must stay quiet before locking
+#define STABILITY_MIN_WEIGHT 20.0f   // g - ignore an empty launch block
+#define STABILITY_RELEASE_DELTA 5.0f // g - change in load that unlocks the reading
+
+// ESP-NOW hello/announce: children resend their name this often so a
+// restarted parent relearns it
+#define ESPNOW_HELLO_INTERVAL 30000
+#define ESPNOW_BATTERY_INTERVAL 30000 // ms between battery reports from a child
+
+// ESP-NOW batching: pack every filtered sample into multi-sample frames
+// instead of one averaged reading per CHILD send tick
+#define ESPNOW_BATCH_MODE 1
+#define ESPNOW_BATCH_INTERVAL 200  // ms - flush a partial batch after this long
+#define ESPNOW_TRACE_SIZE 128      // samples kept per child on the parent (power of two)
+#define ESPNOW_TRACE_NODES MAX_NODES // child IDs 1..N that get a trace
+
+// Reliable ESP-NOW commands (parent -> child)
+#define ESPNOW_MAX_PENDING MAX_NODES // commands awaiting ACK at once (a tare to every node fits)
+#define ESPNOW_RETRY_BASE_MS 40      // first retry delay, doubled each attempt
+#define ESPNOW_RETRY_MAX_MS 640      // cap for the retry delay
+#define ESPNOW_MAX_ATTEMPTS 6        // frames sent before giving up
+
+// Parent ESP-NOW ingest: the radio callback only copies frames into a ring,
+// a consumer task decodes them
+#define ESPNOW_INGEST_QUEUE 32       // frames (power of two)
+#define ESPNOW_RX_TASK_CORE 1
+#define ESPNOW_RX_TASK_PRIORITY 3
+#define ESPNOW_RX_TASK_STACK 4096
+
+// Parent node registry
+#define MAX_NODES 16                 // children tracked at once
+#define NODE_TIMEOUT_MS 5000         // no frame for this long = offline
+#define NODE_EXPIRE_MS 600000        // forget a node after 10 minutes of silence
+#define NODE_RATE_WINDOW_MS 2000     // packet rate averaging window
+
+// ESP-NOW pairing: an unpaired child broadcasts a pair request on each
+// channel in turn until a parent answers with its node ID
+#define ESPNOW_PAIR_DWELL_MS 150       // time spent listening on each channel
+#define ESPNOW_PAIR_MAX_CHANNEL 13
+#define ESPNOW_PAIR_LOST_FAILURES 30   // failed sends in a row before re-pairing
+
+// Parent/child time sync (NTP-style ping/pong over ESP-NOW)
+#define ESPNOW_TIMESYNC_INTERVAL 2000  // ms between pings to each child
+#define NODE_CLOCK_WINDOW 8            // exchanges kept; the lowest-RTT one wins
+
+// Binary WebSocket weight stream (see weight-frame.h)
+#define WS_WEIGHT_FRAME_MAX 4096   // bytes; samples that don't fit wait for the next frame
+
+// WebSocket push: weights are sent when new ESP-NOW data arrives
+#define WS_MIN_PUSH_INTERVAL 100     // ms; updates closer together are coalesced
+#define WS_HEARTBEAT_INTERVAL 2500   // ms; push anyway so offline nodes show up
+#define WS_PUSH_TASK_CORE 1
+#define WS_PUSH_TASK_PRIORITY 2
+#define WS_PUSH_TASK_STACK 4096
+#define WS_TOPICS_MAX_CLIENTS 8      // subscriptions tracked (matches the library's client limit)
+
+// Parent weight history for /api/history (see history.h)
+#define HISTORY_STEP_MS 1000         // one point per second...
+#define HISTORY_POINTS 300           // ...for 5 minutes; 1.2 KB per node
+
+// Weigh-in log on LittleFS (see weighlog.h)
+#define WEIGHLOG_FILE_RECORDS 1024   // 52 KB per file, two files kept
+#define WEIGHLOG_QUEUE 16            // weigh-ins waiting for the writer (power of two)
+#define WEIGHLOG_FLUSH_DELAY 2000    // ms to gather weigh-ins into one flash write
+#define WEIGHLOG_TASK_CORE 1
+#define WEIGHLOG_TASK_PRIORITY 1
+#define WEIGHLOG_TASK_STACK 4096
+
+// Wall clock for weigh log records (see wallclock.h)
+#define WALLCLOCK_NTP_SERVER "pool.ntp.org"
+#define WALLCLOCK_VALID_AFTER 1704067200  // 2024-01-01 UTC; anything earlier means not set
+
+// Spec compliance (see spec.h)
+#define SPEC_DEFAULT_MIN_WEIGHT 550.0f    // grams, class 0 until one is set
+#define ESPNOW_SPEC_REFRESH_INTERVAL 10000 // ms between re-sends of each child's class
+
+// Static page assets (see web-assets.h)
+#define WEB_ASSETS_MAX 24             // files indexed at boot
+#define WEB_ASSET_MAX_AGE 86400       // s a browser may reuse images/icons without asking
+
+// Storage worker for settings writes (see storage.h)
+#define STORAGE_DEBOUNCE_MS 500      // write once requests for an item are this quiet...
+#define STORAGE_MAX_DELAY_MS 3000    // ...or this long after the first unwritten change
+#define STORAGE_MAX_WAITERS 4        // WebSocket clients acked per write
+#define STORAGE_TASK_CORE 1
+#define STORAGE_TASK_PRIORITY 1
+#define STORAGE_TASK_STACK 4096
+
+// Lane switches on GPIO interrupts (see lane-switches.h)
+#define LANE_PRESSED_LEVEL HIGH      // switch opens to HIGH (INPUT_PULLUP)
+#define LANE_DEBOUNCE_MS 20          // a new level must hold this long
+#define LANE_RESYNC_MS 1000          // re-read the pins when no edge came for this long
+#define LANE_EVENT_QUEUE 32          // edges waiting for the task (power of two)
+#define LANE_TASK_CORE 1
+#define LANE_TASK_PRIORITY 3         // above the WebSocket push task
+#define LANE_TASK_STACK 4096
+
+// Pooled WebSocket send buffers (see ws-topics.h)
+#define WS_BUFFER_POOL 8              // buffers kept for reuse
+#define WS_BUFFER_SIZE 512            // bytes each starts with
+#define WS_BUFFER_MAX 6144            // a pooled buffer may grow to this; bigger messages allocate
+#define WS_BUFFER_POOL_BYTES 16384    // total the pool may keep; past it grown buffers shrink back
+#define NODES_JSON_MAX (MAX_NODES * 320)  // room for the node registry as JSON
+
+// Team roster (pit-caller page), kept as one NVS blob
+#define TEAM_ROSTER_MAX_BYTES 8192    // encoded roster; about 300 names of 25 characters
+
+// OLED display task (see display-oled.h)
+#define DISPLAY_TEXT_MAX 96           // characters kept from a text request (4 lines of 21 fit)
+#define DISPLAY_I2C_CLOCK 800000      // SSD1306 modules run well above the 400 kHz datasheet rate; use 400000 if the panel glitches
+#define DISPLAY_I2C_CHUNK 127         // data bytes per I2C transfer (ESP32 Wire buffer is 128)
+#define DISPLAY_TASK_CORE 1
+#define DISPLAY_TASK_PRIORITY 1
+#define DISPLAY_TASK_STACK 4096
+
+// Battery monitor (see battery.h)
+#define BATTERY_SAMPLE_INTERVAL 1000  // ms between readings
+#define BATTERY_CONVERSIONS 64        // ADC samples averaged per reading
+#define BATTERY_ADC_FREQ_HZ 20000     // continuous mode rate (the ESP32 minimum)
+#define BATTERY_SMOOTHING 0.1f        // weight of a new reading in the running average
+#define BATTERY_RATE_WINDOW_MS 300000 // drain rate is measured over this long
+#define BATTERY_LOW_SOC 20            // percent; pages flag the node for a swap
+#define BATTERY_TASK_CORE 1
+#define BATTERY_TASK_PRIORITY 1
+#define BATTERY_TASK_STACK 3072
+
+// Child idle policy (see power.h)
+#define POWER_IDLE_AFTER_MS 600000    // empty this long -> idle (0 = never idle)
+#define POWER_IDLE_ZERO_G 20.0f       // |weight| below this counts as an empty launch block
+#define POWER_IDLE_SAMPLE_MS 500      // one HX711 conversion this often while idle
+#define POWER_HX711_SETTLE_MS 600     // wait for the first conversion after power-up (400 ms at 10 Hz)
+#define POWER_IDLE_LOOP_MS 500        // loop() pass interval while idle
+#define POWER_ACTIVE_CPU_MHZ 240
+#define POWER_IDLE_CPU_MHZ 80         // lowest clock the radio runs at
+#define POWER_IDLE_WAKE_INTERVAL_MS 200 // ESP-NOW listens once per interval while idle
+#define POWER_IDLE_WAKE_WINDOW_MS 50  // ... for this long (command retries span ~1.2 s)
+// Timed light sleep while idle, where automatic light sleep is not available
+// (stock cores have no tickless idle). A parent command is retried for
+// ~1.2 s with gaps up to ESPNOW_RETRY_MAX_MS, so a listen window at least
+// that long with sleeps short enough that one always falls inside the
+// retries means a tare is never missed (checked in power.cpp).
+#define POWER_IDLE_SLEEP_MS 500       // each light sleep
+#define POWER_IDLE_LISTEN_MS 700      // awake (radio listening) between sleeps
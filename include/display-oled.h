@@ -7,15 +7,24 @@
   Written by Limor Fried/Ladyada for Adafruit Industries, with contributions from the open source community. BSD license, check license.txt for more information All text above, and the splash screen below must be included in any redistribution.
 *********/
 
+#include "spec.h"
+
 #define SCREEN_WIDTH 128 // OLED display width, in pixels
 #define SCREEN_HEIGHT 32 // OLED display height, in pixels
 
 // Declaration for an SSD1306 display connected to I2C (SDA, SCL pins)
 #define OLED_RESET -1 // Reset pin # (or -1 if sharing Arduino reset pin)
+#define OLED_ADDRESS 0x3C
 
+// displaysetup() starts a display task that owns the SSD1306. The calls
+// below only post a render request and return at once; the task draws the
+// newest one, skips it if nothing changed and sends only changed columns.
 void displaysetup();
 void displayText(String message, float voltage = NAN);
-void drawBatteryIcon(float voltage);
+void drawBatteryIcon(float voltage);   // display task only
 // `voltage` is the measured battery voltage (single cell):
 // 2.8V = empty, 4.2V = full. If voltage >= ~4.9V treat as external USB (show bolt).
-void displayWeight(String weight, float voltage = NAN);
+// `settled` marks the reading as locked by the stability detector; with a
+// `verdict` the tag shows PASS or FAIL (inverted) instead of SETTLED
+void displayWeight(String weight, float voltage = NAN, bool settled = false,
+                   SpecVerdict verdict = SPEC_VERDICT_NONE);
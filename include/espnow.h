@@ -9,55 +9,241 @@
 enum ESPNowMsgType {
   MSG_TYPE_WEIGHT = 1,    // Weight data from child
   MSG_TYPE_TARE = 2,      // Tare command from parent
-  MSG_TYPE_ACK = 3        // Acknowledgment
+  MSG_TYPE_ACK = 3,       // Acknowledgment
+  MSG_TYPE_SETTLED = 4,   // Settled (locked) weight event from child
+  MSG_TYPE_HELLO = 5,     // Child announces its hostname
+  MSG_TYPE_WEIGHT_BATCH = 6, // Many timestamped samples in one frame
+  MSG_TYPE_PAIR_REQUEST = 7, // Unpaired child looking for a parent (broadcast)
+  MSG_TYPE_PAIR_RESPONSE = 8, // Parent assigns the child its node ID
+  MSG_TYPE_TIME_PING = 9,   // Parent starts a time-sync exchange
+  MSG_TYPE_TIME_PONG = 10,  // Child answers with its receive/send times
+  MSG_TYPE_SPEC = 11,       // Parent tells a child which spec class it weighs for
+  MSG_TYPE_BATTERY = 12     // Child reports its battery
 };
 
-// Message structure for ESP-NOW communication
+// Wire format
+// Every frame starts with ESPNowHeader. Receivers drop frames with the
+// wrong magic, and ignore types they do not know, so new message types
+// can be added without breaking older firmware. Newer versions may append
+// fields to a payload; receivers only require the fields they know.
+#define ESPNOW_MAGIC 0xD5
+#define ESPNOW_PROTO_VERSION 1
+
+// Weights travel as signed fixed point in 0.01 g units
+#define ESPNOW_WEIGHT_SCALE 100.0f
+
+// Flags carried with a weight
+#define ESPNOW_WEIGHT_FLAG_SETTLED 0x01
+#define ESPNOW_WEIGHT_FLAG_HAS_VERDICT 0x02  // child judged it against its spec
+#define ESPNOW_WEIGHT_FLAG_PASS 0x04
+
+typedef struct __attribute__((packed)) {
+  uint8_t magic;          // ESPNOW_MAGIC
+  uint8_t version;        // ESPNOW_PROTO_VERSION of the sender
+  uint8_t type;           // Message type (MSG_TYPE_*)
+  uint8_t id;             // Sender node ID (0 = parent)
+  uint16_t seq;           // Per-sender sequence number
+} ESPNowHeader;
+
+// MSG_TYPE_WEIGHT / MSG_TYPE_SETTLED
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  int32_t weight;         // 0.01 g units
+  uint32_t timestamp;     // Sender millis() when the sample was taken
+  uint8_t flags;          // ESPNOW_WEIGHT_FLAG_*
+} ESPNowWeightMsg;
+
+// One sample inside a batch: time offset from the batch base + weight
+typedef struct __attribute__((packed)) {
+  uint16_t dt;            // ms after ESPNowBatchMsg.baseTime
+  int32_t weight;         // 0.01 g units
+} ESPNowBatchSample;
+
+// Samples that fit in one frame alongside the batch header
+#define ESPNOW_BATCH_MAX ((ESP_NOW_MAX_DATA_LEN - sizeof(ESPNowHeader) - 5) / sizeof(ESPNowBatchSample))
+
+// MSG_TYPE_WEIGHT_BATCH - only the first `count` samples are transmitted
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  uint32_t baseTime;      // Sender millis() of the first sample
+  uint8_t count;          // Number of samples that follow
+  ESPNowBatchSample samples[ESPNOW_BATCH_MAX];
+} ESPNowBatchMsg;
+
+// MSG_TYPE_HELLO - sent once at start-up, then rarely, so the parent can
+// learn names without every weight packet carrying them
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  char name[24];          // Hostname of sending node (NUL-terminated)
+} ESPNowHelloMsg;
+
+// MSG_TYPE_TARE - reliable command: hdr.seq identifies it for the ACK,
+// and retries resend the identical frame so children can drop duplicates
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  uint8_t target;         // Node ID to tare (0 = all)
+} ESPNowCommandMsg;
+
+// MSG_TYPE_ACK - child confirms a command
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  uint8_t ackType;        // Type of the command being acknowledged
+  uint16_t ackSeq;        // hdr.seq of the command being acknowledged
+} ESPNowAckMsg;
+
+// MSG_TYPE_PAIR_REQUEST - hdr.id is the ID the child would like (0 = any)
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  char name[24];          // Name of the child (NUL-terminated)
+} ESPNowPairRequestMsg;
+
+// MSG_TYPE_PAIR_RESPONSE - unicast back to the requesting child
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  uint8_t childMac[6];    // Child this answer is for
+  uint8_t nodeId;         // ID the child must use from now on
+  uint8_t channel;        // WiFi channel the parent listens on
+} ESPNowPairResponseMsg;
+
+// MSG_TYPE_TIME_PING - parent -> child. Times are esp_timer_get_time() us.
+// Also hands the child the offset the parent has settled on, so the child
+// can work in the shared (parent) time base.
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  int64_t parentTime;     // t1: parent send time
+  int64_t offset;         // child clock - parent clock (us), if offsetValid
+  uint8_t offsetValid;
+} ESPNowTimePingMsg;
+
+// MSG_TYPE_TIME_PONG - child -> parent, sent straight from the radio callback
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  int64_t parentTime;     // t1 echoed back
+  int64_t rxTime;         // t2: child receive time
+  int64_t txTime;         // t3: child send time
+} ESPNowTimePongMsg;
+
+// MSG_TYPE_SPEC - parent -> child, resent periodically (it is state, not
+// a command, so no ACK is needed)
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  int32_t minWeight;      // 0.01 g units
+  char className[12];     // NUL-terminated
+} ESPNowSpecMsg;
+
+// MSG_TYPE_BATTERY - child -> parent every ESPNOW_BATTERY_INTERVAL
+typedef struct __attribute__((packed)) {
+  ESPNowHeader hdr;
+  uint16_t millivolts;    // smoothed battery voltage
+  int8_t soc;             // percent, BATTERY_SOC_EXTERNAL on USB power
+  uint16_t minutesLeft;   // BATTERY_MINUTES_UNKNOWN until a drain rate is known
+} ESPNowBatteryMsg;
+
+// Pre-versioning frame (36 bytes, no header). Still accepted so old and
+// new firmware can share a field; new frames are never this length.
 typedef struct {
   uint8_t type;           // Message type (MSG_TYPE_*)
   uint8_t id;             // Node ID (1-255)
   float value;            // Weight (for MSG_TYPE_WEIGHT) or scale index (for MSG_TYPE_TARE)
   char name[24];          // Hostname of sending node (NUL-terminated)
   uint32_t timestamp;     // Timestamp in ms
-} ESPNowData;
+} ESPNowLegacyData;
+
+// A settled weight received by the parent, for its own display
+typedef struct {
+  uint8_t node;
+  float weight;           // grams
+  uint8_t verdict;        // SpecVerdict
+} ESPNowWeighIn;
 
-// Initialize ESP-NOW (parent or child mode based on config)
+// A timestamped weight kept in the parent's per-node trace
+typedef struct {
+  uint32_t timestamp;     // Child millis() when the sample was taken
+  float weight;           // grams
+} WeightPoint;
+
+// Initialize ESP-NOW (parent or child mode from the node identity)
 void espnowInit();
 
 // get the MAC address of the ESP32 board
 void readMacAddress();
 
 // ESP-NOW callbacks
+// On the parent espnowOnRecv only copies the frame into a lock-free ingest
+// ring; a consumer task decodes it and updates node state
 void espnowOnSend(const uint8_t *mac_addr, esp_now_send_status_t status);
 void espnowOnRecv(const uint8_t *mac_addr, const uint8_t *data, int len);
 
+// Outcome of a reliable command, reported once per command (parent only)
+// ok: child acknowledged; rttMs: first send to ACK; attempts: frames sent
+typedef void (*ESPNowCommandResultCallback)(uint8_t nodeId, uint8_t cmdType, bool ok,
+                                            uint32_t rttMs, uint8_t attempts);
+void espnowSetCommandResultCallback(ESPNowCommandResultCallback callback);
+
+// Called on the parent's ingest task after frames that carried new weights
+// have been stored, so the web layer can push without polling. Keep it short.
+typedef void (*ESPNowDataCallback)();
+void espnowSetDataCallback(ESPNowDataCallback callback);
+
 // Send tare command to child node (parent only)
-// nodeId: target child node ID, whichScale: 1 or 2 (which scale to tare)
-void espnowSendTare(uint8_t nodeId);
+// Unicast to the child's MAC once it has been heard from, retried with
+// exponential backoff until the child ACKs. Returns false if the command
+// could not be queued (the result callback then reports it as failed).
+bool espnowSendTare(uint8_t nodeId);
 
-// Get weight data received from a specific child node
-// Returns NaN if no data available or node not found
-float espnowGetChildWeight(uint8_t childId);
+// Send a tare command to every child in the node registry (parent only)
+// Returns the number of commands queued
+int espnowSendTareAll();
 
-// Get the last-known hostname for a child node (empty string if unknown)
-const char* espnowGetChildName(uint8_t childId);
+// Current time in the parent's time base (esp_timer us). On a child this
+// needs a completed time sync; returns false until then.
+bool espnowSharedTime(int64_t *us);
+
+// Frames dropped because the parent's ingest ring was full
+uint32_t espnowIngestDropped();
 
 // Check if there's a pending tare command for this node (child only)
 // Returns: scale number (1 or 2) if tare needed, 0 if none
 uint8_t espnowGetPendingTareCommand();
 
 // Called regularly to handle any pending ESP-NOW tasks
+// (parent: ACK matching and command retries; child: pairing, batch flush
+// and periodic hello announce)
 void espnowLoop();
 
-// Add a weight reading to the buffer (child only)
-// Should be called frequently to collect samples over window
-void espnowBufferWeight(float weight);
+// True once the child has a parent to send to (child only)
+bool espnowIsPaired();
+
+// Announce this node's hostname to the parent (child only)
+void espnowSendHello();
+
+// Report the battery state to the parent (child only)
+void espnowSendBattery();
+
+// `timestamp` is the sender millis() the sample was taken (not sent)
+void espnowSendWeight(float weight, uint32_t timestamp);
+
+// Queue one sample for the next batch frame (child only, batch mode)
+// The batch is flushed when full or ESPNOW_BATCH_INTERVAL has passed
+void espnowQueueBatchSample(uint32_t timestamp, float weight);
+
+// Send whatever is queued in the current batch now (child only)
+void espnowFlushBatch();
+
+// Copy out the oldest samples received from a child without removing them
+// (parent only). Returns the number of points written to `out` (at most
+// `maxPoints`); pass the number actually sent on to espnowReleaseChildTrace()
+size_t espnowPeekChildTrace(uint8_t childId, WeightPoint *out, size_t maxPoints);
+
+// Drop the oldest `count` samples of a child's trace (parent only)
+void espnowReleaseChildTrace(uint8_t childId, size_t count);
 
-void espnowSendWeight(float weight);
+// Send a settled weight event to the parent straight away (child only),
+// with the verdict against this node's spec class (a SpecVerdict)
+void espnowSendSettledWeight(float weight, uint8_t verdict, uint32_t timestamp);
 
-// Get the average weight and send if interval has passed (child only)
-// Should be called regularly from main loop
-void espnowSendAveragedWeightIfReady();
+// Next settled weight received from a child (parent only, call from loop())
+bool espnowNextWeighIn(ESPNowWeighIn *out);
 
 // Print connected peer information (debug)
 void espnowPrintPeers();
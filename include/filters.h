@@ -0,0 +1,128 @@
+// filters.h
+// Compile-time digital filter stages for raw HX711 counts.
+// Every stage works on int32_t counts and has its parameters fixed as
+// template arguments, so a chain compiles down to a few integer ops.
+//
+// Stages are combined with FilterChain, e.g.
+//   FilterChain<MedianFilter<5>, MovingAverage<8>, IirFilter<2>>
+// config.h defines the chains as SCALE_FILTER_PROFILE_n; each node picks
+// one by number (stored in NVS, see identity.h).
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Median of the last N samples - rejects single-sample spikes
+template <size_t N>
+class MedianFilter {
+  static_assert(N % 2 == 1 && N >= 3 && N <= 15, "MedianFilter size must be odd, 3..15");
+
+public:
+  int32_t process(int32_t x) {
+    if (!_primed) {
+      for (size_t i = 0; i < N; i++) _history[i] = x;
+      _primed = true;
+    }
+    _history[_index] = x;
+    _index = (_index + 1) % N;
+
+    // insertion sort a copy - cheap for the small N used here
+    int32_t sorted[N];
+    for (size_t i = 0; i < N; i++) {
+      int32_t v = _history[i];
+      size_t j = i;
+      while (j > 0 && sorted[j - 1] > v) {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = v;
+    }
+    return sorted[N / 2];
+  }
+
+  void reset() { _primed = false; _index = 0; }
+
+private:
+  int32_t _history[N];
+  size_t _index = 0;
+  bool _primed = false;
+};
+
+// Boxcar mean of the last N samples (N a power of two so the divide is a shift)
+template <size_t N>
+class MovingAverage {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "MovingAverage size must be a power of two");
+
+  static constexpr unsigned log2(size_t n) { return n <= 1 ? 0 : 1 + log2(n / 2); }
+
+public:
+  int32_t process(int32_t x) {
+    if (!_primed) {
+      for (size_t i = 0; i < N; i++) _history[i] = x;
+      _sum = (int64_t)x * N;
+      _primed = true;
+    }
+    _sum += x - _history[_index];
+    _history[_index] = x;
+    _index = (_index + 1) & (N - 1);
+    return (int32_t)(_sum >> log2(N));
+  }
+
+  void reset() { _primed = false; _index = 0; }
+
+private:
+  int32_t _history[N];
+  int64_t _sum = 0;
+  size_t _index = 0;
+  bool _primed = false;
+};
+
+// One-pole low-pass: y += (x - y) / 2^SHIFT
+// State carries FRAC extra fractional bits so small steps are not lost
+template <unsigned SHIFT>
+class IirFilter {
+  static_assert(SHIFT >= 1 && SHIFT <= 8, "IirFilter shift must be 1..8");
+  static constexpr unsigned FRAC = 6;  // 24-bit counts + 6 bits still fit in int32
+
+public:
+  int32_t process(int32_t x) {
+    int32_t scaled = x * (1 << FRAC);
+    if (!_primed) {
+      _state = scaled;
+      _primed = true;
+    }
+    _state += (scaled - _state) >> SHIFT;
+    return _state >> FRAC;
+  }
+
+  void reset() { _primed = false; }
+
+private:
+  int32_t _state = 0;
+  bool _primed = false;
+};
+
+// Runs each stage in order: the output of one feeds the next
+template <typename... Stages>
+class FilterChain;
+
+template <>
+class FilterChain<> {
+public:
+  int32_t process(int32_t x) { return x; }
+  void reset() {}
+};
+
+template <typename First, typename... Rest>
+class FilterChain<First, Rest...> {
+public:
+  int32_t process(int32_t x) { return _rest.process(_first.process(x)); }
+  void reset() { _first.reset(); _rest.reset(); }
+
+private:
+  First _first;
+  FilterChain<Rest...> _rest;
+};
+
+#endif  // FILTERS_H
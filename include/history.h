@@ -0,0 +1,45 @@
+// history.h
+// Parent: a downsampled ring of recent weights per node, so a browser that
+// opens (or reconnects to) the scale page can draw the whole window at once
+// from GET /api/history instead of starting with empty graphs. Live
+// updates keep coming over the WebSocket; no per-client state is kept.
+//
+// Each ring holds HISTORY_POINTS slots of HISTORY_STEP_MS, each slot the
+// mean of the weights received in it. Response format, little-endian:
+//   u8  magic            HISTORY_MAGIC ('H')
+//   u8  version          HISTORY_VERSION
+//   u32 parentNow        parent millis() when the response started
+//   u16 stepMs           HISTORY_STEP_MS
+//   then until the end of the response, per node:
+//     u8  id
+//     u8  nameLen, then nameLen bytes of name
+//     u32 newestTime     parent ms at the start of the newest slot
+//     u16 count
+//     count x i32 weight 0.01 g, oldest first; HISTORY_GAP = no data
+// Decoded by decodeHistory() in data/scale-script.js; keep both in step.
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include "nodes.h"
+
+#define HISTORY_MAGIC 0x48
+#define HISTORY_VERSION 1
+#define HISTORY_GAP INT32_MIN
+
+// Largest block produced by historyEncodeHeader / historyEncodeNode
+#define HISTORY_BLOCK_MAX (1 + 1 + NODE_NAME_LEN + 4 + 2 + 4 * HISTORY_POINTS)
+
+void historyInit();
+
+// Add a weight for a node at a time on the parent's clock (ms)
+void historyRecord(uint8_t id, uint32_t timeMs, float weight);
+
+// Response header; returns its length
+size_t historyEncodeHeader(uint8_t *buf, size_t cap);
+
+// Encode the history ring at `index` (0 .. MAX_NODES-1). Returns the block
+// length, 0 if that ring is unused, or -1 once `index` is past the end.
+int historyEncodeNode(int index, uint8_t *buf, size_t cap);
+
+#endif  // HISTORY_H
@@ -0,0 +1,48 @@
+// identity.h
+// Per-device identity kept in NVS so one firmware image serves every node:
+// role (parent/child), node ID, name, calibration factor, filter profile,
+// and (children) the parent found by the ESP-NOW pairing handshake.
+// Provision over serial with the commands listed by "help".
+#ifndef IDENTITY_H
+#define IDENTITY_H
+
+#include <Arduino.h>
+
+#define IDENTITY_NAME_LEN 24
+
+// Load the identity from NVS (falls back to the defaults in config.h).
+// Call first in setup(), before anything asks for the role.
+void identityInit();
+
+bool identityIsParent();
+uint8_t identityNodeId();        // 0 on the parent and on unpaired children
+const char *identityName();      // hostname / display name
+float identityCalibration();     // HX711 scale factor
+uint8_t identityFilterProfile(); // SCALE_FILTER_PROFILE_n to use (child)
+
+// Child: parent MAC and channel from the last successful pairing
+bool identityIsPaired();
+bool identityGetParentMac(uint8_t *mac);
+uint8_t identityChannel();
+
+// Setters persist to NVS straight away
+void identitySetRole(bool parent);   // takes effect after a reboot
+void identitySetNodeId(uint8_t id);
+void identitySetName(const char *name);
+void identitySetCalibration(float factor);
+void identitySetFilterProfile(uint8_t profile);
+void identitySetPairing(const uint8_t *parentMac, uint8_t channel, uint8_t nodeId);
+void identityClearPairing();         // keeps the node ID as the one to ask for
+
+// Parent: pick the node ID for a pairing child. A MAC that paired before
+// keeps its ID; otherwise the requested ID is granted if free, else the
+// lowest free one. Returns 0 if every ID slot is taken.
+uint8_t identityAssignNodeId(const uint8_t *mac, uint8_t requested);
+
+// Parent: forget every pairing (children keep their IDs and re-pair)
+void identityClearAssignments();
+
+// Poll the serial port for provisioning commands (call from loop())
+void identityHandleSerial();
+
+#endif  // IDENTITY_H
@@ -0,0 +1,21 @@
+// lane-switches.h
+// Parent: lane switches read by GPIO edge interrupts. The ISR only
+// timestamps the edge and queues it; a task runs a debounce state machine
+// per lane and reports a press once the new level has held for
+// LANE_DEBOUNCE_MS, so a press reaches the callback LANE_DEBOUNCE_MS plus
+// a task switch after the first edge, and a held switch costs nothing.
+#ifndef LANE_SWITCHES_H
+#define LANE_SWITCHES_H
+
+#include <Arduino.h>
+
+#define LANE_SWITCHES_MAX 8
+
+// Called on the lane task with the lane index and the esp_timer time (us)
+// of the first edge of the press
+typedef void (*LanePressCallback)(int lane, int64_t edgeUs);
+
+// Attach the interrupts and start the task. `pins` must stay valid.
+void laneSwitchesInit(const uint8_t *pins, int count, LanePressCallback callback);
+
+#endif  // LANE_SWITCHES_H
@@ -0,0 +1,30 @@
+// latency.h
+// End-to-end latency histograms on the parent. Each stage keeps log2
+// buckets of microseconds, so recording is a couple of integer ops and the
+// whole set fits in a few hundred bytes.
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+
+enum LatencyStage {
+  LATENCY_SAMPLE_TO_RX = 0,  // child sample instant -> parent radio receive
+  LATENCY_RX_TO_WS,          // parent radio receive -> WebSocket send
+  LATENCY_SAMPLE_TO_WS,      // sample -> WebSocket send ("sample-to-screen")
+  LATENCY_LANE_TO_WS,        // lane switch edge -> pilot swap announcement sent
+  LATENCY_STAGE_COUNT
+};
+
+// Bucket i counts values in [2^(i-1), 2^i) us; bucket 0 is < 1 us
+#define LATENCY_BUCKETS 24
+
+// Add one measurement (negative values are clamped to 0)
+void latencyRecord(LatencyStage stage, int64_t us);
+
+// Clear every histogram
+void latencyReset();
+
+// Histograms as JSON (for /api/latency)
+String latencyAsJson();
+
+#endif  // LATENCY_H
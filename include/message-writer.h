@@ -0,0 +1,57 @@
+// message-writer.h
+// JSON writer for outgoing WebSocket and API messages. It appends to a
+// byte vector but never grows it past the capacity the vector already has,
+// so filling a pooled buffer (wsBufferClaim(), see ws-topics.h) does not
+// touch the heap. Commas between members are added automatically and
+// strings are escaped. If the message does not fit, `overflow` is set and
+// the message must not be sent.
+#ifndef MESSAGE_WRITER_H
+#define MESSAGE_WRITER_H
+
+#include <Arduino.h>
+#include <vector>
+
+class MessageWriter {
+public:
+  // Clears `out` and writes into its existing capacity
+  explicit MessageWriter(std::vector<uint8_t> &out);
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+
+  // Member name inside an object; the value follows
+  void key(const char *name);
+
+  void value(const char *str);   // nullptr writes null
+  void value(const String &str) { value(str.c_str()); }
+  void value(int v) { value((long long)v); }
+  void value(unsigned int v) { value((unsigned long long)v); }
+  void value(long v) { value((long long)v); }
+  void value(unsigned long v) { value((unsigned long long)v); }
+  void value(long long v);
+  void value(unsigned long long v);
+  void value(float v, int decimals); // NaN writes null
+  void value(bool v);
+  void null();
+  // Already-serialised JSON (an array or object from elsewhere)
+  void raw(const char *json, size_t len);
+
+  // key + value in one call
+  template <typename T> void field(const char *name, const T &v) { key(name); value(v); }
+  void field(const char *name, float v, int decimals) { key(name); value(v, decimals); }
+
+  size_t length() const { return out.size(); }
+  bool overflow;
+
+private:
+  std::vector<uint8_t> &out;
+  bool needComma;
+
+  void put(char c);
+  void putBytes(const char *data, size_t len);
+  void separate();
+};
+
+#endif  // MESSAGE_WRITER_H
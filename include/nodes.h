@@ -0,0 +1,88 @@
+// nodes.h
+// Fixed-capacity registry of child nodes seen by the parent, with per-node
+// link health. Written by the ESP-NOW ingest task, read by the web server;
+// all access goes through these functions (internally locked).
+#ifndef NODES_H
+#define NODES_H
+
+#include <Arduino.h>
+
+#define NODE_NAME_LEN 24
+
+struct NodeInfo {
+  uint8_t id;                    // Node ID (1-255)
+  uint8_t mac[6];                // MAC the node was last heard from
+  char name[NODE_NAME_LEN + 1];  // Hostname from the hello message
+  float weight;                  // Last weight in grams
+  float settledWeight;           // Last settled weight (NaN if none / released)
+  uint8_t verdict;               // SpecVerdict of settledWeight
+  uint32_t lastSeen;             // millis() of the last frame
+  float packetRate;              // frames per second over the last window
+  uint32_t packets;              // frames received
+  uint32_t lossCount;            // frames missing from the sequence numbers
+  uint32_t sendFailures;         // parent -> node sends that were not delivered
+  int8_t rssi;                   // signal strength of the last frame (dBm, 0 = unknown)
+  bool clockSynced;              // clockOffset is valid
+  int64_t clockOffset;           // child esp_timer - parent esp_timer (us)
+  uint32_t clockRtt;             // round trip of the exchange clockOffset came from (us)
+  int64_t lastRxTime;            // parent time the latest weight arrived (us)
+  int64_t lastSampleTime;        // parent time the latest weight was sampled (us, 0 = unknown)
+  uint16_t batteryMv;            // battery voltage the node reported (0 = no report yet)
+  int8_t batterySoc;             // percent, BATTERY_SOC_EXTERNAL on USB power
+  uint16_t batteryMinutes;       // time left, BATTERY_MINUTES_UNKNOWN if not known
+};
+
+void nodesInit();
+
+// Record a frame from a node: creates the entry if needed, updates MAC,
+// last-seen, packet rate and sequence-gap loss. `hasSeq` is false for
+// legacy frames. Returns false if the registry is full.
+bool nodesTouch(uint8_t id, const uint8_t *mac, uint16_t seq, bool hasSeq);
+
+// Store a weight; `settled` marks a locked reading from the stability
+// detector, `verdict` (a SpecVerdict) its pass/fail against the spec
+void nodesSetWeight(uint8_t id, float weight, bool settled, uint8_t verdict = 0);
+void nodesSetName(uint8_t id, const char *name);
+// Battery report from a child (see battery.h for the sentinels)
+void nodesSetBattery(uint8_t id, uint16_t millivolts, int8_t soc, uint16_t minutesLeft);
+
+// Time sync: add one ping/pong result. The offset kept is the one from the
+// exchange with the smallest round trip among the last NODE_CLOCK_WINDOW.
+void nodesUpdateClock(uint8_t id, int64_t offsetUs, uint32_t rttUs);
+
+// Map a time on a child's clock onto the parent's (both esp_timer us).
+// Returns false until the node has completed a time sync.
+bool nodesChildToParentTime(uint8_t id, int64_t childUs, int64_t *parentUs);
+
+// When the latest weight arrived and when it was sampled (parent clock, us)
+void nodesSetTiming(uint8_t id, int64_t rxUs, int64_t sampleUs);
+
+// Link events reported by MAC address
+void nodesRecordSendFailure(const uint8_t *mac);
+void nodesRecordRssi(const uint8_t *mac, int8_t rssi);
+
+// Copy the MAC for a node; returns false if the node is unknown
+bool nodesGetMac(uint8_t id, uint8_t *mac);
+
+// Copy the name (NODE_NAME_LEN + 1 bytes); returns false if the node is unknown
+bool nodesGetName(uint8_t id, char *name);
+
+// Copy the IDs of all known nodes; returns how many were written
+int nodesListIds(uint8_t *ids, int maxIds);
+
+// Copy every known node into `out`; returns how many were written
+int nodesSnapshot(NodeInfo *out, int maxNodes);
+
+// True if the node has been heard from within NODE_TIMEOUT_MS
+bool nodesIsOnline(const NodeInfo &node, uint32_t now);
+
+// Drop nodes that have been silent for NODE_EXPIRE_MS
+void nodesExpire();
+
+// Registry as a JSON array (for /api/nodes). nodesWriteJson() writes the
+// same array into a caller's buffer, so pushes need no String.
+class MessageWriter;
+void nodesWriteJson(MessageWriter &w);
+String nodesAsJson();
+
+#endif  // NODES_H
@@ -13,35 +13,47 @@
 extern AsyncWebSocket ws;
 extern AsyncWebServer server;
 
+// A lane's countdown is a deadline on the parent's millis() clock; pages
+// get it once when the swap starts and tick it down themselves
 struct ButtonState {
   String teamName;
-  int countdown;
+  bool counting;
+  unsigned long deadline;   // millis() when the countdown ends (counting)
 };
 
 
 #define NUM_LANES 4
 extern const uint8_t lanePins[NUM_LANES];
 extern unsigned long lastCheckTime;
-extern unsigned long countdownTimers[NUM_LANES];
 extern int countdownTimer;
 extern ButtonState buttonStates[NUM_LANES];
 extern String customAnnounceMessageBefore;
 extern String customAnnounceMessageAfter;
 extern int numSavedTeams;
 
-void notifyButtonClients();
-void handleWebSocketMessage(void *arg, uint8_t *data, size_t len);
+// Lane names and countdowns to one page, or every lane subscriber (nullptr)
+void notifyButtonClients(AsyncWebSocketClient *client = nullptr);
+// Seconds left on a lane's countdown (0 = none running)
+int pitCountdownRemaining(int lane);
+void handleWebSocketMessage(AsyncWebSocketClient *client, JsonDocument &doc);
 void initpitbuttons();
 void pilotSwap(String teamId, String buttonId);
 void update(String teamId, String teamName);
 void updateCustomMessages(String customMessageBefore, String customMessageAfter);
-void getCustomMessages();
-void announcePilotSwap(int lane);
-void saveTeamNamesInPreferences(String message);
-void getTeamNamesFromPreferences();
-void getCountdownTimer();
-void updateCountdownTimer(int timer);
-void checkLaneSwitches();
+void getCustomMessages(AsyncWebSocketClient *client);  // nullptr = every pit page
+void announcePilotSwap(int lane, int64_t edgeUs = 0);
+// Saves go to RAM at once and to NVS through the storage task, which acks
+// `clientId` (0 = nobody) when they are on flash. False if the roster is
+// over TEAM_ROSTER_MAX_BYTES.
+bool saveTeamNamesInPreferences(JsonArrayConst teamNames, uint32_t clientId = 0);
+// Team roster from RAM; only the version if the page's copy is current
+void getTeamNames(AsyncWebSocketClient *client, uint32_t cachedVersion);
+void getCountdownTimer(AsyncWebSocketClient *client);
+void updateCountdownTimer(int timer, uint32_t clientId = 0);
+// storage task writers (see storage.h)
+bool pitWriteTeamNames(const String &content);
+bool pitWriteCountdownTimer(const String &content);
+void onLanePressed(int lane, int64_t edgeUs);
 void cleanupWebClients();
 
 #endif  // PITWEB_H
\ No newline at end of file
@@ -0,0 +1,34 @@
+// power.h
+// Child idle policy. When the launch block has read empty for
+// POWER_IDLE_AFTER_MS the child goes idle: the HX711 is powered down
+// between single conversions every POWER_IDLE_SAMPLE_MS, the CPU clock
+// drops and the radio only listens in short windows, with automatic light
+// sleep in between where the core supports it and timed light sleep from
+// loop() where it does not. Weight on the block (seen
+// by the next idle conversion) or a command from the parent brings it
+// straight back to full rate.
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+// Child only, after initScale() and espnowInit()
+void powerInit();
+
+// Feed the latest reading (loop()); enters idle once it has stayed empty
+void powerUpdate(float weight);
+
+// Back to full rate now. Safe from any task.
+void powerWake(const char *reason);
+
+bool powerIsIdle();
+
+// How long loop() should wait between passes
+uint32_t powerLoopDelay();
+
+// Idle without automatic light sleep (stock cores): after each
+// POWER_IDLE_LISTEN_MS awake, light sleep for POWER_IDLE_SLEEP_MS. Call
+// from loop(); returns at once when not due.
+void powerIdleSleep();
+
+#endif  // POWER_H
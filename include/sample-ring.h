@@ -0,0 +1,97 @@
+// sample-ring.h
+// Single-producer / single-consumer lock-free ring buffer.
+// One task (or ISR/callback) pushes, one task pops; no mutex is needed
+// because each index is only ever written by one side.
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SampleRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SampleRing size must be a power of two");
+
+public:
+  // Producer side. Returns false (and counts a drop) if the ring is full.
+  bool push(const T &item) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    if (head - tail >= N) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    _items[head & (N - 1)] = item;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T &item) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t head = _head.load(std::memory_order_acquire);
+    if (tail == head) return false;
+    item = _items[tail & (N - 1)];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Producer side, in place: get the next free slot (nullptr if full and
+  // counts a drop), fill it, then publish it with commitPush()
+  T *beginPush() {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= N) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &_items[head & (N - 1)];
+  }
+
+  void commitPush() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Consumer side, in place: look at the oldest item (nullptr if empty),
+  // then release the slot with releasePop()
+  T *peek() {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) return nullptr;
+    return &_items[tail & (N - 1)];
+  }
+
+  void releasePop(size_t count = 1) {
+    _tail.store(_tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  // Consumer side: copy up to maxItems of the oldest items without removing
+  // them; release the ones actually used with releasePop(count)
+  size_t peekMany(T *out, size_t maxItems) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t avail = _head.load(std::memory_order_acquire) - tail;
+    size_t n = avail < maxItems ? avail : maxItems;
+    for (size_t i = 0; i < n; i++) out[i] = _items[(tail + i) & (N - 1)];
+    return n;
+  }
+
+  // Consumer side: discard everything currently queued
+  void clear() {
+    _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+  size_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+  static constexpr size_t capacity() { return N; }
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  T _items[N];
+  std::atomic<size_t> _head{0};
+  std::atomic<size_t> _tail{0};
+  std::atomic<uint32_t> _dropped{0};
+};
+
+#endif  // SAMPLE_RING_H
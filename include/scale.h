@@ -5,12 +5,36 @@
 
 #include "HX711.h"
 
+// One HX711 conversion as captured by the acquisition task
+struct ScaleSample {
+  uint32_t timestamp;     // millis() when the conversion was read
+  int32_t raw;            // raw 24-bit signed counts from the HX711
+};
+
 void initScale();
 void scaleTare(); // Tare the scale
-float scaleRead(); // Read from the scale
+float scaleRead(); // Latest filtered reading from scaleUpdate() (non-blocking)
+uint32_t scaleReadTime();     // millis() when the conversion behind scaleRead() was taken
+uint32_t scaleSettledTime();  // millis() of the sample that locked the last settled reading
 float scaleDummyRead();  // For testing without scale
 float scaleCalibrate(); // Calibrate the scale
 
+// Drain new samples into the stability detector (call every loop pass)
+// `onSample` (optional) is called with every filtered sample in grams
+// Returns true when a new settled reading has just been locked in
+bool scaleUpdate(void (*onSample)(uint32_t timestamp, float weight) = nullptr);
 
+// Start the background acquisition task (called from initScale)
+void scaleStartAcquisition();
+// Pop the oldest unread sample from the acquisition ring (non-blocking)
+// Returns false if no new sample is available
+bool scalePopSample(ScaleSample &sample);
+// Convert raw counts to units using the current offset and calibration
+float scaleToUnits(int32_t raw);
+// Number of samples dropped because the ring was full
+uint32_t scaleDroppedSamples();
+// Idle mode (see power.h): the HX711 is powered down and sampled once
+// every POWER_IDLE_SAMPLE_MS instead of at its full rate
+void scaleSetIdle(bool idle);
 
 #endif  // SCALE_H
\ No newline at end of file
@@ -8,7 +8,10 @@ String settingsGetName(int which);
 String settingsGetColor(int which);
 void settingsSetName(int which, const String &name);
 void settingsSetColor(int which, const String &color);
+// queue a write to flash (see storage.h); false if it could not be queued
 bool settingsSave();
+// storage task: write the queued contents
+bool settingsWrite(const String &content);
 String settingsAsJson();
 void settingsResetDefaults();
 
@@ -0,0 +1,55 @@
+// spec.h
+// Spec compliance: minimum-weight classes and pass/fail verdicts.
+// The parent owns the classes and which class each node weighs for
+// (saved in /spec.json) and pushes each child its class over ESP-NOW.
+// The child judges its own settled readings, shows PASS/FAIL on its OLED
+// and sends the verdict with the settled weight; the parent re-judges it
+// against its own copy so the weigh log pairs each verdict with its limits.
+#ifndef SPEC_H
+#define SPEC_H
+
+#include <Arduino.h>
+
+#define SPEC_MAX_CLASSES 4
+#define SPEC_NAME_LEN 11
+
+enum SpecVerdict {
+  SPEC_VERDICT_NONE = 0,   // no spec known
+  SPEC_VERDICT_PASS,
+  SPEC_VERDICT_FAIL
+};
+
+struct SpecClass {
+  char name[SPEC_NAME_LEN + 1];
+  float minWeight;          // grams
+};
+
+// Parent: load the classes and node assignments (after initLittleFS())
+void specInit();
+
+// Parent: class table. Every node weighs for class 0 unless assigned.
+int specClassCount();
+bool specGetClass(int index, SpecClass *out);
+bool specSetClasses(const SpecClass *classes, int count);
+uint8_t specNodeClass(uint8_t nodeId);
+void specSetNodeClass(uint8_t nodeId, uint8_t classIndex);
+bool specSave();                          // queued, see storage.h
+bool specWrite(const String &content);    // storage task
+String specAsJson();
+
+// Parent: class a node should be judged against. False if there are no
+// classes yet.
+bool specForNode(uint8_t nodeId, SpecClass *out);
+
+// Bumped on every change, so the ESP-NOW layer knows to push it out
+uint32_t specVersion();
+
+// Child: the class received from the parent (radio callback) and a
+// verdict for a settled weight against it
+void specSetLocal(const SpecClass &spec);
+bool specGetLocal(SpecClass *out);
+
+// Judge a weight against a class
+SpecVerdict specCheck(const SpecClass &spec, float weight);
+
+#endif  // SPEC_H
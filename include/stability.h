@@ -0,0 +1,22 @@
+// stability.h
+// Settled-weight detector for the child scale. Fed with every sample from
+// the acquisition ring; reports the moment a reading stops moving.
+#ifndef STABILITY_H
+#define STABILITY_H
+
+#include <Arduino.h>
+
+// Clear the window and any locked reading (e.g. after a tare)
+void stabilityReset();
+
+// Add one sample (grams). Returns true exactly once when a new settled
+// reading is locked in; read it with stabilitySettledWeight().
+bool stabilityAddSample(uint32_t timestamp, float weight);
+
+// True while the locked reading is still valid (load has not changed)
+bool stabilityIsSettled();
+
+// The last locked weight (NaN if nothing has settled yet)
+float stabilitySettledWeight();
+
+#endif  // STABILITY_H
@@ -0,0 +1,40 @@
+// storage.h
+// Storage worker: every settings write to LittleFS or NVS goes through one
+// low-priority task, so the web server and WebSocket handlers never wait on
+// a flash erase. A handler updates its RAM copy, serialises it and hands the
+// text to storageRequest(); the task writes it once requests for that item
+// have been quiet for STORAGE_DEBOUNCE_MS (or STORAGE_MAX_DELAY_MS have
+// passed), so a burst of changes costs one write. Files are written to a
+// temporary file and renamed over the old one, so a power cut leaves either
+// the old or the new version.
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <Arduino.h>
+
+enum StorageItem {
+  STORAGE_SETTINGS = 0,   // /settings.json
+  STORAGE_SPEC,           // /spec.json
+  STORAGE_TEAM_NAMES,     // NVS "teamNames"
+  STORAGE_COUNTDOWN,      // NVS "timer"
+  STORAGE_ITEM_COUNT
+};
+
+// Called from the storage task once an item is on flash (or failed), for
+// each WebSocket client that asked for the write
+typedef void (*StorageAckCallback)(uint32_t clientId, const char *item, bool ok);
+
+// Start the storage task (after initLittleFS(), before the web server)
+void storageInit();
+
+// Queue new contents for an item; a pending write of the same item is
+// replaced. `clientId` (0 = nobody) is acked when it is written. Never
+// touches flash; returns false if the task is not running.
+bool storageRequest(StorageItem item, const String &content, uint32_t clientId = 0);
+
+void storageSetAckCallback(StorageAckCallback callback);
+
+// Write a file atomically (temporary file + rename). Storage task only.
+bool storageWriteFile(const char *path, const String &content);
+
+#endif  // STORAGE_H
@@ -0,0 +1,21 @@
+// wallclock.h
+// Time of day for the weigh log. The board has no RTC, so the clock starts
+// unset at every boot; SNTP sets it once the STA is connected, and on the
+// access point (no internet) the first browser that connects sets it from
+// its own clock.
+#ifndef WALLCLOCK_H
+#define WALLCLOCK_H
+
+#include <Arduino.h>
+
+// Start SNTP. Call once the STA is connected.
+void wallClockStartSntp();
+
+// Time from a page (Date.now(), ms since 1970). Only used while the clock
+// is unset; SNTP still corrects it later.
+void wallClockFromPage(int64_t unixMs);
+
+// Seconds since 1970 UTC, or 0 if the clock is not set yet
+uint32_t wallClockNow();
+
+#endif  // WALLCLOCK_H
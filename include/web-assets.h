@@ -0,0 +1,23 @@
+// web-assets.h
+// Static page assets (HTML, scripts, styles, icons) served from LittleFS.
+// The filesystem image is built from data/ with the text assets gzipped
+// (scripts/compress_data.py), so they are sent as stored with
+// Content-Encoding: gzip. Every asset gets a strong ETag worked out once at
+// boot, so a browser revalidating its cache gets a 304 without the file
+// being opened.
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Index the assets on LittleFS (after initLittleFS(), before the server
+// starts; the table is read-only afterwards)
+void webAssetsInit();
+
+// Send the asset for a URL path ("/dir/" means "/dir/index.html"), or a
+// 304 if the request already holds the current version. Returns false if
+// there is no such asset.
+bool webAssetsSend(AsyncWebServerRequest *request, const String &path);
+
+#endif  // WEB_ASSETS_H
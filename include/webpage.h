@@ -8,7 +8,8 @@
 
 void initwebservers();
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
-// called regularly from the main loop to broadcast data
+// called regularly from the main loop to clean up closed websocket clients
+// (weights are pushed by a task as new data arrives)
 void webBroadcastLoop();
 
 // send calibration result back to clients (which: 1 or 2, clientId optional)
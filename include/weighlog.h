@@ -0,0 +1,63 @@
+// weighlog.h
+// Parent: append-only log of weigh-ins (settled weights from the children)
+// on LittleFS, so results survive the browser tab and can be audited.
+//
+// Fixed-size binary records after an 8-byte file header (u32 magic, u16
+// version, u16 record size). The current file holds up to
+// WEIGHLOG_FILE_RECORDS records; when full it becomes the previous file and
+// a new one starts, so at most two generations are on flash. Version 1
+// files (no wall-clock time) are rewritten as version 2 at boot. Records are
+// queued by the ESP-NOW ingest task and written by a low-priority task in
+// batches, so neither the radio path nor loop() waits on flash and each
+// flash write covers several weigh-ins.
+#ifndef WEIGHLOG_H
+#define WEIGHLOG_H
+
+#include <Arduino.h>
+#include "nodes.h"
+#include "spec.h"
+
+#define WEIGHLOG_MAGIC 0x474F4C57   // "WLOG"
+#define WEIGHLOG_VERSION 2
+
+// Record flags
+#define WEIGHLOG_HAS_SPEC 0x01   // a minimum spec was set at the time
+#define WEIGHLOG_PASS     0x02   // weight >= spec
+
+struct WeighLogRecord {
+  uint32_t seq;                 // counts up across files and reboots
+  uint16_t boot;                // parent boot number the record was made in
+  uint8_t node;
+  uint8_t flags;                // WEIGHLOG_* above
+  uint32_t uptimeMs;            // parent millis() at the weigh-in
+  int32_t weight;               // 0.01 g
+  int32_t spec;                 // 0.01 g (WEIGHLOG_HAS_SPEC)
+  char name[NODE_NAME_LEN];     // node name, not NUL-terminated if full
+  uint8_t specClass;            // index of the spec class (WEIGHLOG_HAS_SPEC)
+  uint8_t reserved[3];
+  uint32_t unixTime;            // seconds since 1970 UTC, 0 = clock not set (version 2)
+};
+static_assert(sizeof(WeighLogRecord) == 52, "weigh log record layout changed");
+
+// Mount-time check of the log files and start of the writer task. Call
+// after initLittleFS(), parent only.
+void weighLogInit();
+
+// Queue a weigh-in with the spec class it was judged against (nullptr =
+// none) and the verdict. Never blocks.
+void weighLogAdd(uint8_t node, float weight, const SpecClass *spec, uint8_t specClass,
+                 SpecVerdict verdict);
+
+// Records on flash (both generations) and records dropped because the
+// queue was full
+uint32_t weighLogCount();
+uint32_t weighLogDropped();
+
+// CSV export, one chunk at a time (for a chunked HTTP response). Create a
+// cursor, call weighLogCsvRead() until it returns 0, then free it.
+struct WeighLogCsvCursor;
+WeighLogCsvCursor *weighLogCsvOpen();
+size_t weighLogCsvRead(WeighLogCsvCursor *cursor, uint8_t *buffer, size_t maxLen);
+void weighLogCsvClose(WeighLogCsvCursor *cursor);
+
+#endif  // WEIGHLOG_H
@@ -0,0 +1,83 @@
+// weight-frame.h
+// Binary WebSocket frame for the live weight stream (parent -> browsers).
+// Decoded by decodeWeightFrame() in data/scale-script.js; keep both in step.
+//
+// All fields little-endian:
+//   u8  magic            WEIGHT_FRAME_MAGIC ('W')
+//   u8  version          WEIGHT_FRAME_VERSION
+//   u32 parentNow        parent millis(), time base of synced samples
+//   u8  nodeCount
+//   per node:
+//     u8  id
+//     u8  flags          WF_* below (WF_HAS_VERDICT / WF_PASS go with the settled weight)
+//     i32 weight         0.01 g              (WF_HAS_WEIGHT)
+//     i32 settled        0.01 g              (WF_HAS_SETTLED)
+//     i8  rssi           dBm                 (WF_HAS_RSSI)
+//     u16 latency        ms, sample age      (WF_HAS_LATENCY)
+//     u16 loss           lost frames (saturating)
+//     u8  battery        percent, WF_BATTERY_EXTERNAL or WF_BATTERY_UNKNOWN (version 2)
+//     u8  nameLen, then nameLen bytes of name
+//     u16 sampleCount
+//     u32 baseTime       ms of the first sample (only if sampleCount > 0)
+//     sampleCount x { u16 dt (ms after baseTime); i32 weight (0.01 g) }
+#ifndef WEIGHT_FRAME_H
+#define WEIGHT_FRAME_H
+
+#include <Arduino.h>
+#include "nodes.h"
+#include "espnow.h"
+
+#define WEIGHT_FRAME_MAGIC 0x57
+#define WEIGHT_FRAME_VERSION 2   // keep in step with data/scale-script.js
+
+#define WF_ONLINE       0x01
+#define WF_HAS_WEIGHT   0x02
+#define WF_HAS_SETTLED  0x04
+#define WF_SYNCED       0x08  // sample times are on the parent's clock
+#define WF_HAS_RSSI     0x10
+#define WF_HAS_LATENCY  0x20
+#define WF_HAS_VERDICT  0x40  // settled weight was judged against a spec
+#define WF_PASS         0x80
+
+// battery byte when there is no percentage
+#define WF_BATTERY_EXTERNAL 0xFE   // on USB / external power
+#define WF_BATTERY_UNKNOWN  0xFF   // no report from the node yet
+
+// Appends little-endian fields to a caller-owned buffer. Writes past the
+// end are dropped and flagged, never overrun.
+struct WeightFrameWriter {
+  uint8_t *buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+
+  WeightFrameWriter(uint8_t *buffer, size_t capacity)
+    : buf(buffer), cap(capacity), len(0), overflow(false) {}
+
+  bool fits(size_t n) const { return len + n <= cap; }
+  void put8(uint8_t v) { if (fits(1)) buf[len++] = v; else overflow = true; }
+  void put16(uint16_t v) { put8(v & 0xFF); put8(v >> 8); }
+  void put32(uint32_t v) { put16(v & 0xFFFF); put16(v >> 16); }
+  void putBytes(const void *data, size_t n) {
+    if (!fits(n)) { overflow = true; return; }
+    memcpy(buf + len, data, n);
+    len += n;
+  }
+};
+
+// Frame header; the node count is patched in by weightFrameEnd()
+void weightFrameBegin(WeightFrameWriter &w, uint32_t parentNow);
+
+// One node record. `latencyMs` < 0 means unknown. Samples that would not
+// fit in the buffer are left out (the rest of the frame stays valid).
+// Returns how many of the leading samples were written.
+size_t weightFrameAddNode(WeightFrameWriter &w, const NodeInfo &node, bool online,
+                        int32_t latencyMs, const WeightPoint *samples, size_t sampleCount);
+
+// How many samples one more node record could still carry
+size_t weightFrameSampleRoom(const WeightFrameWriter &w);
+
+// Returns the frame length
+size_t weightFrameEnd(WeightFrameWriter &w);
+
+#endif  // WEIGHT_FRAME_H
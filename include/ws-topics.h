@@ -0,0 +1,63 @@
+// ws-topics.h
+// Topic subscriptions for the shared /ws WebSocket. The scale page and the
+// pit-caller page connect to the same socket; each client says which
+// topics it wants with {"type":"subscribe","topics":["weights",...]} and
+// only gets messages for those. A client that never subscribes gets every
+// topic, so older pages keep working.
+#ifndef WS_TOPICS_H
+#define WS_TOPICS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+
+// Topic bits
+#define WS_TOPIC_WEIGHTS 0x01   // binary weight frames, tare/calibration results
+#define WS_TOPIC_LANES   0x02   // lane countdowns, pilot swaps, announcements
+#define WS_TOPIC_TEAMS   0x04   // team name list
+#define WS_TOPIC_HEALTH  0x08   // node registry / link health ("node-health")
+#define WS_TOPIC_ALL     0x0F
+
+// Track clients as they come and go (from the WebSocket event handler)
+void wsTopicsConnect(uint32_t clientId);
+void wsTopicsDisconnect(uint32_t clientId);
+
+// Replace a client's subscriptions with the topics named in a JSON array.
+// Returns the new topic mask (unknown names are ignored).
+uint8_t wsTopicsSubscribe(uint32_t clientId, JsonArrayConst topics);
+
+// Number of connected clients subscribed to a topic, so callers can skip
+// building a message nobody wants
+int wsTopicsSubscribers(uint8_t topic);
+
+// Send to every client subscribed to the topic. The message is copied once
+// into a pooled buffer shared by all client queues; a client whose queue
+// is full skips it.
+void wsTopicsText(uint8_t topic, const char *message, size_t len);
+void wsTopicsText(uint8_t topic, const String &message);
+void wsTopicsBinary(uint8_t topic, const uint8_t *data, size_t len);
+
+// Send a message already built in a claimed buffer, without copying it
+void wsTopicsText(uint8_t topic, AsyncWebSocketSharedBuffer buffer);
+
+// Pooled send buffers. A buffer is free again once every client queue has
+// released it, so after the first few messages sending does not allocate.
+// A claimed buffer is empty with at least `capacity` bytes of room (fill it
+// with MessageWriter); it comes from the heap only if the pool is busy or
+// its buffers have to grow. The pool keeps at most WS_BUFFER_POOL_BYTES in
+// total; a buffer that would take it past that shrinks back instead.
+void wsBuffersInit();
+AsyncWebSocketSharedBuffer wsBufferClaim(size_t capacity);
+
+struct WsBufferStats {
+  int inUse;              // pooled buffers held by client queues
+  size_t pooledBytes;     // capacity of all pooled buffers
+  uint32_t reused;        // claims served from the pool without allocating
+  uint32_t allocations;   // claims that allocated (new buffer or growth)
+};
+WsBufferStats wsBufferStats();
+
+// Messages not queued because a client's queue was full
+uint32_t wsTopicsSkipped();
+
+#endif  // WS_TOPICS_H
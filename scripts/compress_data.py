@@ -0,0 +1,40 @@
+# compress_data.py
+# PlatformIO pre-script: the LittleFS image is built from a copy of data/
+# in .pio/data-gz with the text assets gzipped (and the originals left out),
+# so the parent sends them as stored with Content-Encoding: gzip.
+# Compression is deterministic (no timestamp in the header), so an
+# unchanged file keeps its ETag across builds.
+import gzip
+import os
+import shutil
+
+Import("env")
+
+COMPRESS = (".html", ".js", ".css", ".svg", ".txt", ".ico")
+
+source_dir = env.subst("$PROJECT_DATA_DIR")
+output_dir = os.path.join(env.subst("$PROJECT_WORKSPACE_DIR"), "data-gz")
+
+
+def build_data_dir():
+    shutil.rmtree(output_dir, ignore_errors=True)
+    before = after = 0
+    for root, dirs, files in os.walk(source_dir):
+        out_root = os.path.join(output_dir, os.path.relpath(root, source_dir))
+        os.makedirs(out_root, exist_ok=True)
+        for name in files:
+            src = os.path.join(root, name)
+            with open(src, "rb") as f:
+                data = f.read()
+            before += len(data)
+            if name.endswith(COMPRESS):
+                data = gzip.compress(data, compresslevel=9, mtime=0)
+                name += ".gz"
+            with open(os.path.join(out_root, name), "wb") as f:
+                f.write(data)
+            after += len(data)
+    print("compress_data: %d -> %d bytes in %s" % (before, after, output_dir))
+
+
+build_data_dir()
+env.Replace(PROJECT_DATA_DIR=output_dir)
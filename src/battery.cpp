@@ -1,10 +1,34 @@
 #include "battery.h"
 #include "config.h"
 #include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if ESP_ARDUINO_VERSION_MAJOR < 3
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#endif
 
 // Global battery voltage variable (defined here, declared as extern in config.h)
 float vbat = 0.0;
 
+// Typical LiPo resting voltage at each 5% of charge (light load), full to empty
+static const float SOC_CURVE[] = {
+  4.20f, 4.15f, 4.11f, 4.08f, 4.02f, 3.98f, 3.95f, 3.91f, 3.87f, 3.85f, 3.84f,
+  3.82f, 3.80f, 3.79f, 3.77f, 3.75f, 3.73f, 3.71f, 3.69f, 3.61f, 3.27f
+};
+static const int SOC_STEPS = sizeof(SOC_CURVE) / sizeof(SOC_CURVE[0]) - 1;
+
+// Written by the battery task, read from loop(), the display and ESP-NOW
+static BatteryStatus status = { NAN, BATTERY_SOC_EXTERNAL, BATTERY_MINUTES_UNKNOWN };
+static portMUX_TYPE batteryMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t batteryTask = NULL;
+
+// Drain rate: SoC at the start of the current window, and the smoothed
+// rate in percent per hour (NaN until a window has passed)
+static unsigned long windowStart = 0;
+static float windowStartSoc = NAN;
+static float drainPerHour = NAN;
+
 // Optional: smoothing
 float readAveragedMilliVolts(int pin, int samples) {
   float sum = 0;
@@ -33,4 +57,179 @@ float readVBAT() {
   debugln("v");
   return actual;
   
-}
\ No newline at end of file
+}
+
+int batterySocForVoltage(float voltage) {
+  // external USB (~>=4.4V) or ADC reads very low: no battery to judge
+  if (isnan(voltage) || voltage >= 4.4f || voltage < 0.10f) return BATTERY_SOC_EXTERNAL;
+  if (voltage >= SOC_CURVE[0]) return 100;
+  if (voltage <= SOC_CURVE[SOC_STEPS]) return 0;
+  int i = 1;
+  while (voltage < SOC_CURVE[i]) i++;
+  // between SOC_CURVE[i] (lower) and SOC_CURVE[i - 1]
+  float frac = (voltage - SOC_CURVE[i]) / (SOC_CURVE[i - 1] - SOC_CURVE[i]);
+  return (int)lroundf((SOC_STEPS - i + frac) * 100.0f / SOC_STEPS);
+}
+
+BatteryStatus batteryStatus() {
+  portENTER_CRITICAL(&batteryMux);
+  BatteryStatus copy = status;
+  portEXIT_CRITICAL(&batteryMux);
+  return copy;
+}
+
+// Fold one reading (volts at the battery) into the status
+static void batteryUpdate(float voltage) {
+  float smoothed = isnan(status.voltage) ? voltage
+                 : status.voltage + BATTERY_SMOOTHING * (voltage - status.voltage);
+  int soc = batterySocForVoltage(smoothed);
+  unsigned long now = millis();
+
+  if (soc == BATTERY_SOC_EXTERNAL) {
+    windowStartSoc = NAN;  // charging or on USB: the old rate no longer holds
+    drainPerHour = NAN;
+  } else if (isnan(windowStartSoc)) {
+    windowStart = now;
+    windowStartSoc = soc;
+  } else if (now - windowStart >= BATTERY_RATE_WINDOW_MS) {
+    float rate = (windowStartSoc - soc) * 3600000.0f / (now - windowStart);
+    if (rate >= 0) drainPerHour = isnan(drainPerHour) ? rate : drainPerHour + 0.3f * (rate - drainPerHour);
+    windowStart = now;
+    windowStartSoc = soc;
+  }
+
+  uint16_t minutes = BATTERY_MINUTES_UNKNOWN;
+  if (soc != BATTERY_SOC_EXTERNAL && drainPerHour > 0.1f) {
+    float left = soc / drainPerHour * 60.0f;
+    minutes = left < BATTERY_MINUTES_UNKNOWN ? (uint16_t)left : BATTERY_MINUTES_UNKNOWN - 1;
+  }
+
+  portENTER_CRITICAL(&batteryMux);
+  status.voltage = smoothed;
+  status.soc = soc;
+  status.minutesLeft = minutes;
+  portEXIT_CRITICAL(&batteryMux);
+  vbat = smoothed;
+}
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+// Continuous mode: the ADC fills a DMA buffer with BATTERY_CONVERSIONS
+// samples while the CPU does other work, then calls back from its ISR.
+// The conversion runs once per interval, not all the time.
+static void ARDUINO_ISR_ATTR batteryAdcDone() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(batteryTask, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+static void batteryTaskLoop(void *param) {
+  const uint8_t pins[] = { VBAT_PIN };
+  analogContinuousSetAtten(ADC_0db);
+  analogContinuousSetWidth(12);
+  bool continuous = analogContinuous(pins, 1, BATTERY_CONVERSIONS, BATTERY_ADC_FREQ_HZ, batteryAdcDone);
+  if (!continuous) Serial.println("Battery ADC continuous mode unavailable, using one-shot reads");
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(BATTERY_SAMPLE_INTERVAL));
+    if (!continuous) {
+      batteryUpdate(readVBAT());
+      continue;
+    }
+    adc_continuous_data_t *result = nullptr;
+    ulTaskNotifyTake(pdTRUE, 0);  // drop a stale notification
+    analogContinuousStart();
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100)) && analogContinuousRead(&result, 0) && result) {
+      batteryUpdate(result[0].avg_read_mvolts / 1000.0f * VBAT_DIVIDER);
+    }
+    analogContinuousStop();
+  }
+}
+#else
+// Core 2 (IDF 4.4): the same continuous/DMA sampling through the ADC's
+// digital controller. Each reading the task starts it, blocks until
+// BATTERY_CONVERSIONS samples are in the DMA buffer and stops it again.
+
+static esp_adc_cal_characteristics_t adcChars;
+static uint8_t adcChannel = 0;
+
+static bool batteryAdcInit() {
+  int8_t channel = digitalPinToAnalogChannel(VBAT_PIN);
+  if (channel < 0 || channel > 7) return false;  // DMA mode here is ADC1 only
+  adcChannel = channel;
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = BATTERY_CONVERSIONS * sizeof(adc_digi_output_data_t) * 2;
+  init.conv_num_each_intr = BATTERY_CONVERSIONS * sizeof(adc_digi_output_data_t);
+  init.adc1_chan_mask = BIT(adcChannel);
+  init.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init) != ESP_OK) return false;
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_0;
+  pattern.channel = adcChannel;
+  pattern.unit = 0;  // ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = true;  // required on the ESP32
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = BATTERY_ADC_FREQ_HZ;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&config) != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
+  esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_0, ADC_WIDTH_BIT_12, 1100, &adcChars);
+  return true;
+}
+
+// One DMA burst; the task sleeps in adc_digi_read_bytes() while it fills
+static bool batteryAdcRead(float *millivolts) {
+  static adc_digi_output_data_t samples[BATTERY_CONVERSIONS];
+  uint32_t sum = 0, count = 0;
+  uint32_t got = 0;
+  // samples left over from the end of the last burst are a second old
+  while (adc_digi_read_bytes((uint8_t *)samples, sizeof(samples), &got, 0) == ESP_OK && got > 0) {}
+  if (adc_digi_start() != ESP_OK) return false;
+  for (int tries = 0; tries < 4 && count < BATTERY_CONVERSIONS; tries++) {
+    if (adc_digi_read_bytes((uint8_t *)samples, sizeof(samples), &got, 100) != ESP_OK) break;
+    for (uint32_t i = 0; i < got / sizeof(adc_digi_output_data_t); i++) {
+      if (samples[i].type1.channel != adcChannel) continue;
+      sum += samples[i].type1.data;
+      count++;
+    }
+  }
+  adc_digi_stop();
+  if (count == 0) return false;
+  *millivolts = esp_adc_cal_raw_to_voltage(sum / count, &adcChars);
+  return true;
+}
+
+static void batteryTaskLoop(void *param) {
+  bool continuous = batteryAdcInit();
+  if (!continuous) Serial.println("Battery ADC DMA mode unavailable, using one-shot reads");
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(BATTERY_SAMPLE_INTERVAL));
+    float mv;
+    if (!continuous) {
+      batteryUpdate(readVBAT());
+    } else if (batteryAdcRead(&mv)) {
+      batteryUpdate(mv / 1000.0f * VBAT_DIVIDER);
+    }
+  }
+}
+#endif
+
+void batteryInit() {
+  // configure VBAT ADC pin
+  analogSetPinAttenuation(VBAT_PIN, ADC_0db);
+  analogReadResolution(12);
+  // get an initial vbat reading
+  batteryUpdate(readVBAT());
+
+  if (xTaskCreatePinnedToCore(batteryTaskLoop, "battery", BATTERY_TASK_STACK, NULL,
+                              BATTERY_TASK_PRIORITY, &batteryTask, BATTERY_TASK_CORE) != pdPASS) {
+    Serial.println("Battery task not started, battery level will not update");
+  }
+}
@@ -2,6 +2,7 @@
 #include "connect-wifi.h"
 #include "config.h"
 #include "display-oled.h"
+#include "wallclock.h"
 
 int visibleNetworks = 0;
 String goodSSID = "";
@@ -11,7 +12,7 @@ String wifiMessage;
 
 void initMDNS() {
     // Initialize mDNS
-    if (!MDNS.begin(HOSTNAME))
+    if (!MDNS.begin(identityName()))
     { // Set the hostname
         Serial.println("Error setting up MDNS responder!");
         while (1)
@@ -23,7 +24,7 @@ void initMDNS() {
 }
 
 void initWifi() {
-  WiFi.setHostname(HOSTNAME);
+  WiFi.setHostname(identityName());
   // Scan for known wifi Networks
   // int networks = scanForWifi();
   if (scanForWifi() > 0 && checkValidSSID()) {
@@ -99,6 +100,7 @@ void connectToWifi(String SSID) {
     wifiMessage = "Connected to \n" + SSID + "\nChannel: " + String(WiFi.channel());
     Serial.println(wifiMessage);
     displayText(wifiMessage, vbat);
+    wallClockStartSntp();
     delay(1000);
 
     wifiMessage = "http:\\\\" + String(WiFi.getHostname()) + "\nIP: " + WiFi.localIP().toString();
@@ -13,17 +13,193 @@
 #include <Adafruit_SSD1306.h>
 #include <math.h>
 #include "display-oled.h"
+#include "battery.h"
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 // #include <WiFi.h>
 
-// OLED display object
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+// OLED display object; after displaysetup() only the display task uses it
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET,
+                         DISPLAY_I2C_CLOCK, DISPLAY_I2C_CLOCK);
 
 String textMessage = "Set up OLED...";
 
+// A render request. Only the newest one matters, so the queue holds one
+// and a new request replaces a waiting one.
+enum DisplayKind { DISPLAY_TEXT, DISPLAY_WEIGHT };
+
+struct DisplayRequest {
+  uint8_t kind;
+  bool settled;
+  uint8_t verdict;
+  float voltage;
+  char text[DISPLAY_TEXT_MAX];
+};
+
+static QueueHandle_t displayQueue = NULL;
+
+// What the panel shows, one byte per 8-pixel column of a page, so only
+// the changed part of each page goes over I2C
+#define DISPLAY_PAGES (SCREEN_HEIGHT / 8)
+static uint8_t shadow[SCREEN_WIDTH * DISPLAY_PAGES];
+
+// Weight digits at text size 3, rasterised once into page format (three
+// pages of 18 columns) and copied into the frame buffer
+#define DIGIT_W 18
+#define DIGIT_PAGES 3
+static const char DIGIT_CHARS[] = "0123456789.-g ";
+static uint8_t digitGlyphs[sizeof(DIGIT_CHARS) - 1][DIGIT_PAGES][DIGIT_W];
+
+static void rasteriseDigits() {
+  GFXcanvas1 canvas(DIGIT_W, DIGIT_PAGES * 8);
+  canvas.setTextSize(3);
+  canvas.setTextColor(WHITE);
+  for (size_t i = 0; i < sizeof(DIGIT_CHARS) - 1; i++) {
+    canvas.fillScreen(BLACK);
+    canvas.setCursor(0, 0);
+    canvas.print(DIGIT_CHARS[i]);
+    for (int page = 0; page < DIGIT_PAGES; page++) {
+      for (int x = 0; x < DIGIT_W; x++) {
+        uint8_t bits = 0;
+        for (int bit = 0; bit < 8; bit++) {
+          if (canvas.getPixel(x, page * 8 + bit)) bits |= 1 << bit;
+        }
+        digitGlyphs[i][page][x] = bits;
+      }
+    }
+  }
+}
+
+// Large text at the top left; characters without a glyph fall back to the
+// normal (slower) font drawing
+static void drawLargeText(const char *text) {
+  uint8_t *buffer = display.getBuffer();
+  int x = 0;
+  for (const char *p = text; *p && x < SCREEN_WIDTH; p++, x += DIGIT_W) {
+    const char *glyph = strchr(DIGIT_CHARS, *p);
+    if (glyph == nullptr) {
+      display.drawChar(x, 0, *p, WHITE, BLACK, 3);
+      continue;
+    }
+    const uint8_t (*columns)[DIGIT_W] = digitGlyphs[glyph - DIGIT_CHARS];
+    int width = SCREEN_WIDTH - x < DIGIT_W ? SCREEN_WIDTH - x : DIGIT_W;
+    for (int page = 0; page < DIGIT_PAGES; page++) {
+      memcpy(buffer + page * SCREEN_WIDTH + x, columns[page], width);
+    }
+  }
+}
+
+static void renderText(const DisplayRequest &req) {
+  display.setTextSize(1);      // Normal 1:1 pixel scale
+  display.setTextColor(WHITE); // Draw white text
+  display.setCursor(0, 0);     // Start top left corner
+  display.cp437(true);         // Use full 256 char 'Code Page 437' font
+
+  display.println(req.text);
+}
+
+static void renderWeight(const DisplayRequest &req) {
+  // Draw weight on the left
+  char text[DISPLAY_TEXT_MAX + 1];
+  snprintf(text, sizeof(text), "%sg", req.text);
+  drawLargeText(text);
+  if (req.settled) {
+    // small tag on the bottom row, left of the battery readout
+    display.setTextSize(1);
+    display.setTextColor(WHITE);
+    display.setCursor(0, SCREEN_HEIGHT - 8);
+    if (req.verdict == SPEC_VERDICT_PASS) {
+      display.print("PASS");
+    } else if (req.verdict == SPEC_VERDICT_FAIL) {
+      display.setTextColor(BLACK, WHITE);
+      display.print("FAIL");
+      display.setTextColor(WHITE);
+    } else {
+      display.print("SETTLED");
+    }
+  }
+}
+
+// Send columns [col0, col1] of one page
+static void sendPageSpan(int page, int col0, int col1) {
+  display.ssd1306_command(SSD1306_PAGEADDR);
+  display.ssd1306_command(page);
+  display.ssd1306_command(page);
+  display.ssd1306_command(SSD1306_COLUMNADDR);
+  display.ssd1306_command(col0);
+  display.ssd1306_command(col1);
+
+  const uint8_t *data = display.getBuffer() + page * SCREEN_WIDTH + col0;
+  size_t left = col1 - col0 + 1;
+  while (left > 0) {
+    size_t n = left < DISPLAY_I2C_CHUNK ? left : DISPLAY_I2C_CHUNK;
+    Wire.beginTransmission(OLED_ADDRESS);
+    Wire.write((uint8_t)0x40);   // data follows
+    Wire.write(data, n);
+    Wire.endTransmission();
+    data += n;
+    left -= n;
+  }
+}
+
+// Transfer only what differs from the panel, page by page. The data
+// transfers bypass the library, so the bus clock is set here and put back
+// afterwards for anything else on the bus.
+static void flushChanges() {
+  const uint8_t *buffer = display.getBuffer();
+  uint32_t previousClock = Wire.getClock();
+  Wire.setClock(DISPLAY_I2C_CLOCK);
+  for (int page = 0; page < DISPLAY_PAGES; page++) {
+    const uint8_t *now = buffer + page * SCREEN_WIDTH;
+    uint8_t *shown = shadow + page * SCREEN_WIDTH;
+    int first = 0;
+    while (first < SCREEN_WIDTH && now[first] == shown[first]) first++;
+    if (first == SCREEN_WIDTH) continue;
+    int last = SCREEN_WIDTH - 1;
+    while (now[last] == shown[last]) last--;
+    sendPageSpan(page, first, last);
+    memcpy(shown + first, now + first, last - first + 1);
+  }
+  Wire.setClock(previousClock);
+}
+
+static void displayTask(void *param) {
+  DisplayRequest req;
+  DisplayRequest shown;
+  bool haveShown = false;
+  for (;;) {
+    if (xQueueReceive(displayQueue, &req, portMAX_DELAY) != pdTRUE) continue;
+    // the same frame again (e.g. an unchanged weight): nothing to draw
+    if (haveShown && memcmp(&req, &shown, sizeof(req)) == 0) continue;
+    memcpy(&shown, &req, sizeof(req));
+    haveShown = true;
+
+    display.clearDisplay();
+    if (req.kind == DISPLAY_WEIGHT) renderWeight(req); else renderText(req);
+    drawBatteryIcon(req.voltage);
+    flushChanges();
+  }
+}
+
+static void displayPost(uint8_t kind, const String &text, float voltage, bool settled,
+                        SpecVerdict verdict) {
+  if (displayQueue == NULL) return;
+  DisplayRequest req;
+  memset(&req, 0, sizeof(req));   // requests are compared byte for byte
+  req.kind = kind;
+  req.settled = settled;
+  req.verdict = verdict;
+  req.voltage = voltage;
+  strlcpy(req.text, text.c_str(), sizeof(req.text));
+  xQueueOverwrite(displayQueue, &req);
+}
+
 void displaysetup() {
 
   // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
-  if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C))
+  if (!display.begin(SSD1306_SWITCHCAPVCC, OLED_ADDRESS))
   {
     Serial.println(F("SSD1306 allocation failed"));
     for (;;)
@@ -34,40 +210,32 @@ void displaysetup() {
   // the library initializes this with an Adafruit splash screen.
   Serial.println(F("Initializing OLED display"));  
   display.display();
+  memcpy(shadow, display.getBuffer(), sizeof(shadow));
   delay(1000); // Pause for 2 seconds
 
   // Clear the screen and prepare for drawing lines
   display.clearDisplay();
 
+  rasteriseDigits();
+  displayQueue = xQueueCreate(1, sizeof(DisplayRequest));
+  if (displayQueue == NULL ||
+      xTaskCreatePinnedToCore(displayTask, "display", DISPLAY_TASK_STACK, NULL,
+                              DISPLAY_TASK_PRIORITY, NULL, DISPLAY_TASK_CORE) != pdPASS) {
+    Serial.println("Display task not started, OLED will not update");
+    if (displayQueue != NULL) vQueueDelete(displayQueue);
+    displayQueue = NULL;
+  }
 }
 
 void displayText(String message, float voltage) {
-
-  display.clearDisplay();
-
-  display.setTextSize(1);      // Normal 1:1 pixel scale
-  display.setTextColor(WHITE); // Draw white text
-  display.setCursor(0, 0);     // Start top left corner
-  display.cp437(true);         // Use full 256 char 'Code Page 437' font
-
-  display.println(message);
-  drawBatteryIcon(voltage);
-  display.display();
+  displayPost(DISPLAY_TEXT, message, voltage, false, SPEC_VERDICT_NONE);
 }
 
-void displayWeight(String weight, float voltage) {
-  display.clearDisplay();
-
-  // Draw weight on the left
-  display.setTextSize(3);
-  display.setTextColor(WHITE);
-  display.setCursor(0, 0);
-  display.print(weight);
-  display.println("g");
-  drawBatteryIcon(voltage);
-  display.display();
+void displayWeight(String weight, float voltage, bool settled, SpecVerdict verdict) {
+  displayPost(DISPLAY_WEIGHT, weight, voltage, settled, verdict);
 }
 
+// Display task only (draws into the frame buffer)
 void drawBatteryIcon(float voltage) {
   // Draw battery indicator in bottom-right (horizontal, compact)
   const int bw = 18; // battery body width
@@ -90,12 +258,8 @@ void drawBatteryIcon(float voltage) {
       display.drawRect(x, y, bw, bh, WHITE);
       display.fillRect(x + bw + 1, y + (bh/2) - 1, tipW, 2, WHITE);
     } else {
-      // Constrain voltage to cell range 3.3..4.2
-      float v = voltage;
-      if (v < 3.3) v = 3.3;
-      if (v > 4.2) v = 4.2;
-      float pct = (v - 3.3) / (4.2 - 3.3);
-      if (pct < 0) pct = 0; if (pct > 1) pct = 1;
+      // level from the LiPo discharge curve (battery.h), not a straight line
+      float pct = batterySocForVoltage(voltage) / 100.0f;
 
       // draw battery outline and tip
       display.drawRect(x, y, bw, bh, WHITE);
@@ -112,9 +276,11 @@ void drawBatteryIcon(float voltage) {
       }
     }
 
-    // Print numeric voltage to left of icon
+    // Print charge (or the voltage on external power) to left of icon
     char vb[8];
-    snprintf(vb, sizeof(vb), "%.1fV", voltage);
+    int soc = batterySocForVoltage(voltage);
+    if (soc == BATTERY_SOC_EXTERNAL) snprintf(vb, sizeof(vb), "%.1fV", voltage);
+    else snprintf(vb, sizeof(vb), "%d%%", soc);
     display.setTextSize(1);
     display.setTextColor(WHITE);
     int tx = x - 2 - (6 * (int)strlen(vb)); // rough width estimate (6 px per char)
@@ -2,29 +2,136 @@
 #include <esp_wifi.h>
 #include <esp_err.h>
 #include "config.h"
-#include <map>
+#include "sample-ring.h"
+#include "nodes.h"
+#include "latency.h"
+#include "history.h"
+#include "weighlog.h"
+#include "spec.h"
+#include "battery.h"
+#include <esp_timer.h>
+#include <atomic>
 
-// Map to store child node weights: childId -> weight
-static std::map<uint8_t, float> childWeights;
-static std::map<uint8_t, String> childNames;
+// Child node state on the parent lives in the node registry (nodes.cpp)
 static uint8_t nodeId = 0;  // This device's ID (set on child nodes)
 static uint8_t pendingTareCommand = 0;  // Pending tare command (scale number, 0 = none)
+// Sequence number for outgoing frames. Frames are built both in the radio
+// callback (ACKs, pongs, pair responses) and on loop(), so it is atomic;
+// only the low 16 bits go on air.
+static std::atomic<uint32_t> txSequence{0};
+static unsigned long lastHelloTime = 0;
+static unsigned long lastBatteryTime = 0;
 
-// Buffering for 500ms average
-static const uint32_t ESPNOW_SEND_INTERVAL = 2000;  // 500ms between sends
-static unsigned long lastSendTime = 0;
-static float weightBuffer[100];  // Buffer for weight samples (enough for ~50 samples at 10ms reading interval)
-static int bufferIndex = 0;
+// Child: batch being filled for the next MSG_TYPE_WEIGHT_BATCH frame
+static ESPNowBatchMsg pendingBatch;
+static uint8_t pendingBatchCount = 0;
+static int64_t pendingBatchSlot = 0;  // shared-time grid slot the batch covers
+
+// Parent: per-node trace of received samples, filled by the receive
+// callback and drained by the web broadcaster (one producer, one consumer)
+static SampleRing<WeightPoint, ESPNOW_TRACE_SIZE> childTraces[ESPNOW_TRACE_NODES];
+
+// Parent: reliable commands waiting for an ACK
+struct PendingCommand {
+  bool active;
+  uint8_t nodeId;
+  uint8_t attempts;           // frames sent so far
+  unsigned long firstSent;
+  unsigned long lastSent;
+  ESPNowCommandMsg msg;       // resent unchanged so the seq stays the same
+};
+static PendingCommand pendingCommands[ESPNOW_MAX_PENDING];
+// pendingCommands is filled from the web server task (tare requests) and
+// serviced from loop(), so both sides take this lock
+static SemaphoreHandle_t commandMutex = NULL;
+
+// A finished command, reported after commandMutex is released so the
+// result callback may queue new commands
+struct CommandResult {
+  uint8_t nodeId;
+  uint8_t type;
+  bool ok;
+  uint32_t rtt;
+  uint8_t attempts;
+};
+
+// ACKs handed from the receive callback to espnowLoop()
+struct AckEvent {
+  uint8_t nodeId;
+  uint8_t ackType;
+  uint16_t ackSeq;
+  unsigned long receivedAt;
+};
+static SampleRing<AckEvent, 16> ackRing;
+static ESPNowCommandResultCallback commandResultCallback = nullptr;
+static ESPNowDataCallback dataCallback = nullptr;
+static bool ingestDataChanged = false;  // ingest task only
+static SampleRing<ESPNowWeighIn, 8> weighIns;  // ingest task -> loop()
+static uint32_t sentSpecVersion = 0;
+static unsigned long lastSpecPush = 0;
+
+// Parent: raw frames copied out of the radio callback. The callback is the
+// only producer and the ingest task the only consumer, so no lock is needed
+struct IngestFrame {
+  uint8_t mac[6];
+  uint8_t len;
+  int64_t rxTime;             // esp_timer us when the radio handed it over
+  uint8_t data[ESP_NOW_MAX_DATA_LEN];
+};
+static SampleRing<IngestFrame, ESPNOW_INGEST_QUEUE> ingestRing;
+static TaskHandle_t ingestTask = NULL;
+
+// Parent: link events (RSSI, failed sends) raised in WiFi task callbacks.
+// Both callbacks run on the WiFi task, so this is still one producer.
+enum LinkEventKind { LINK_EVENT_RSSI, LINK_EVENT_SEND_FAIL };
+struct LinkEvent {
+  uint8_t mac[6];
+  uint8_t kind;
+  int8_t rssi;
+};
+static SampleRing<LinkEvent, 32> linkEvents;
+
+// Child: last command accepted from the parent, to drop retried duplicates
+static bool haveLastCommand = false;
+static uint16_t lastCommandSeq = 0;
+
+// Child: pairing. The radio callback stores the parent's answer, the loop
+// persists it (NVS writes don't belong in the WiFi task)
+static uint8_t ownMac[6];
+static uint8_t pairChannel = ESPNOW_CHANNEL;
+static unsigned long lastPairAttempt = 0;
+static volatile bool pairResponseReady = false;
+static ESPNowPairResponseMsg pairResponse;
+static uint8_t pairResponseMac[6];
+static volatile uint16_t parentSendFailures = 0;  // unacknowledged sends in a row
+
+// Child: offset to the parent's clock, handed over in time-sync pings.
+// Written in the radio callback, so 64-bit reads/writes take the spinlock.
+static portMUX_TYPE sharedClockMux = portMUX_INITIALIZER_UNLOCKED;
+static bool haveSharedOffset = false;
+static int64_t sharedOffset = 0;  // child clock - parent clock (us)
+
+// Parent: time-sync ping schedule and a scratch copy of the registry
+static unsigned long lastTimeSync = 0;
+static NodeInfo syncSnapshot[MAX_NODES];
+
+static void espnowStartIngest();
+static bool espnowEnsurePeer(const uint8_t *mac);
 
 void espnowInit() {
+  nodesInit();
+  historyInit();
+  if (commandMutex == NULL) commandMutex = xSemaphoreCreateMutex();
+
   // Initialize WiFi in station mode (required for ESP-NOW)
   WiFi.mode(WIFI_STA);
 
-  if (!ESPNOW_IS_PARENT) {
-    // Child nodes can set a static channel if needed
-    WiFi.channel(ESPNOW_CHANNEL);
-    esp_wifi_set_channel(ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+  if (!identityIsParent()) {
+    // Child: listen on the channel we last paired on (or the default)
+    pairChannel = identityChannel();
+    esp_wifi_set_channel(pairChannel, WIFI_SECOND_CHAN_NONE);
   }
+  esp_wifi_get_mac(WIFI_IF_STA, ownMac);
 
   // stop wifi from sleeping
   esp_wifi_set_ps(WIFI_PS_NONE);
@@ -45,41 +152,42 @@ void espnowInit() {
   
   Serial.print("ESP-NOW initialized. Mode: ");
   
-  if (ESPNOW_IS_PARENT) {
+  // Broadcast peer on the current channel: parent commands, child pair requests
+  uint8_t broadcastMac[] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+  esp_now_peer_info_t peerInfo = {};
+  memcpy(peerInfo.peer_addr, broadcastMac, 6);
+  peerInfo.channel = 0;
+  peerInfo.encrypt = false;
+  esp_err_t addres = esp_now_add_peer(&peerInfo);
+  if (addres != ESP_OK) {
+    Serial.print("Warning: failed to add broadcast peer: "); Serial.println(esp_err_to_name(addres));
+  } else {
+    Serial.println("Broadcast peer added");
+  }
+
+  if (identityIsParent()) {
     Serial.println("PARENT");
-    // Parent node doesn't need to add itself as a peer
-    // Child nodes will be added when they pair
-    // Add a broadcast peer so parent can send commands to all children
-    uint8_t broadcastMac[] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, broadcastMac, 6);
-    peerInfo.channel = ESPNOW_CHANNEL;
-    peerInfo.encrypt = false;
-    esp_err_t addres = esp_now_add_peer(&peerInfo);
-    if (addres != ESP_OK) {
-      Serial.print("Warning: failed to add broadcast peer: "); Serial.println(esp_err_to_name(addres));
-    } else {
-      Serial.println("Broadcast peer added");
-    }
+    // start command sequence numbers somewhere random so a rebooted parent
+    // doesn't look like a duplicate of its previous life to the children
+    txSequence = esp_random();
+    espnowStartIngest();
+    // Child nodes are added as unicast peers when they pair
   } else {
     Serial.println("CHILD");
     Serial.print("Node ID: ");
-    Serial.println(DEVICE_ID);
+    Serial.println(identityNodeId());
     Serial.print("Child Wifi Channel: ");
-    Serial.println(ESPNOW_CHANNEL);
-    
-    // Child adds parent as a peer
-    uint8_t parentMac[] = PARENT_MAC_ADDR;
-    esp_now_peer_info_t peerInfo = {};
-    memcpy(peerInfo.peer_addr, parentMac, 6);
-    peerInfo.channel = ESPNOW_CHANNEL;
-    peerInfo.encrypt = false;
-    
-    if (esp_now_add_peer(&peerInfo) != ESP_OK) {
-      Serial.println("Failed to add parent as peer");
-      return;
-    } else
-      Serial.println("Parent peer added");
+    Serial.println(pairChannel);
+
+    // Child adds the parent it paired with as a peer; otherwise
+    // espnowLoop() goes looking for one
+    uint8_t parentMac[6];
+    if (identityGetParentMac(parentMac)) {
+      if (espnowEnsurePeer(parentMac)) Serial.println("Parent peer added");
+      else Serial.println("Failed to add parent as peer");
+    } else {
+      Serial.println("Not paired - searching for a parent");
+    }
   }
 }
 
@@ -99,9 +207,21 @@ void espnowOnSend(const uint8_t *mac_addr, esp_now_send_status_t status) {
   // Serial.print("status message is: ");
   // Serial.println(status);
 
+  bool toParent = !identityIsParent() && mac_addr[0] != 0xFF;
   if (status == ESP_NOW_SEND_SUCCESS) {
-    // Successful send - nothing special needed
+    if (toParent) parentSendFailures = 0;
   } else {
+    if (toParent && parentSendFailures < 0xFFFF) parentSendFailures++;
+    if (identityIsParent() && mac_addr[0] != 0xFF) {
+      LinkEvent *ev = linkEvents.beginPush();
+      if (ev) {
+        memcpy(ev->mac, mac_addr, 6);
+        ev->kind = LINK_EVENT_SEND_FAIL;
+        ev->rssi = 0;
+        linkEvents.commitPush();
+        if (ingestTask != NULL) xTaskNotifyGive(ingestTask);
+      }
+    }
     Serial.print("ESP-NOW send failed to: ");
     Serial.print(mac_addr[0], HEX);
     for (int i = 1; i < 6; i++) {
@@ -112,91 +232,598 @@ void espnowOnSend(const uint8_t *mac_addr, esp_now_send_status_t status) {
   }
 }
 
-void espnowOnRecv(const uint8_t *mac_addr, const uint8_t *data, int len) {
-  if (len == sizeof(ESPNowData)) {
-    ESPNowData *payload = (ESPNowData *)data;
-    
-    if (ESPNOW_IS_PARENT) {
-      // Parent receiving data from child
-      if (payload->type == MSG_TYPE_WEIGHT) {
-        Serial.print("Received from node ");
-        Serial.print(payload->id);
-        Serial.print(" (");
-        Serial.print(payload->name);
-        Serial.print("): ");
-        Serial.print(payload->value, 1);
-        Serial.println(" g");
-        
-        // Store the weight data
-        childWeights[payload->id] = payload->value;
-        // store hostname if present
-        if (payload->name[0] != '\0') {
-          childNames[payload->id] = String(payload->name);
-        }
-      } else if (payload->type == MSG_TYPE_ACK) {
-        Serial.print("Node ");
-        Serial.print(payload->id);
-        Serial.println(" acknowledged command");
-      }
-    } else {
-      // Child receiving commands from parent
-      if (payload->type == MSG_TYPE_TARE) {
-        Serial.print("Received tare command for node id ");
-        Serial.println((uint8_t)payload->id);
-        // Only accept if addressed to this node (or id==0 for broadcast)
-        if ((uint8_t)payload->id == DEVICE_ID || (uint8_t)payload->id == 0) {
-          // mark pending tare (use 1 to indicate tare request)
-          pendingTareCommand = 1;
-          Serial.println("Tare queued");
-        } else {
-          Serial.println("Tare ignored (not for this node)");
-        }
+// Fill in the common frame header for an outgoing message
+static void espnowFillHeader(ESPNowHeader &hdr, uint8_t type) {
+  hdr.magic = ESPNOW_MAGIC;
+  hdr.version = ESPNOW_PROTO_VERSION;
+  hdr.type = type;
+  hdr.id = identityIsParent() ? 0 : identityNodeId();
+  hdr.seq = (uint16_t)txSequence.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Parent: note when a child's latest weight was sampled and received.
+// The sample time is only known once the child has been time-synced.
+static void espnowRecordTiming(uint8_t id, uint32_t sampleMs, int64_t rxTime) {
+  int64_t sampleTime = 0;
+  if (nodesChildToParentTime(id, (int64_t)sampleMs * 1000, &sampleTime)) {
+    latencyRecord(LATENCY_SAMPLE_TO_RX, rxTime - sampleTime);
+  } else {
+    sampleTime = 0;
+  }
+  nodesSetTiming(id, rxTime, sampleTime);
+}
+
+// Parent: store a weight (or settled weight) from a child
+static void espnowStoreChildWeight(uint8_t id, uint8_t type, float value, uint8_t flags) {
+  if (type == MSG_TYPE_SETTLED) {
+    // Re-judge against the spec the parent holds now, so the logged verdict
+    // always matches the logged limits. The child's verdict (what its OLED
+    // showed) may predate a spec change that has not reached it yet; it is
+    // only used when the parent has no spec at all.
+    SpecClass spec;
+    bool haveSpec = specForNode(id, &spec);
+    SpecVerdict childVerdict = SPEC_VERDICT_NONE;
+    if (flags & ESPNOW_WEIGHT_FLAG_HAS_VERDICT) {
+      childVerdict = (flags & ESPNOW_WEIGHT_FLAG_PASS) ? SPEC_VERDICT_PASS : SPEC_VERDICT_FAIL;
+    }
+    SpecVerdict verdict = haveSpec ? specCheck(spec, value) : childVerdict;
+
+    Serial.print("Settled from node ");
+    Serial.print(id);
+    Serial.print(": ");
+    Serial.print(value, 1);
+    Serial.print(" g");
+    Serial.print(verdict == SPEC_VERDICT_PASS ? " PASS" : verdict == SPEC_VERDICT_FAIL ? " FAIL" : "");
+    if (haveSpec && childVerdict != SPEC_VERDICT_NONE && childVerdict != verdict) {
+      Serial.print(" (node showed ");
+      Serial.print(childVerdict == SPEC_VERDICT_PASS ? "PASS" : "FAIL");
+      Serial.print(", spec not yet updated)");
+    }
+    Serial.println();
+
+    nodesSetWeight(id, value, true, verdict);
+    weighLogAdd(id, value, haveSpec ? &spec : nullptr, specNodeClass(id), verdict);
+    ESPNowWeighIn event = { id, value, (uint8_t)verdict };
+    weighIns.push(event);
+    ingestDataChanged = true;
+    return;
+  }
+
+  debug("Received from node ");
+  debug(id);
+  debug(": ");
+  debugln(String(value, 1) + " g");
+
+  // Store the weight data (also releases a stale settled reading)
+  nodesSetWeight(id, value, false);
+  historyRecord(id, millis(), value);
+  ingestDataChanged = true;
+}
+
+// Parent: unpack a batch frame into the node's trace
+static void espnowStoreChildBatch(uint8_t id, const ESPNowBatchMsg *msg, int len, int64_t rxTime) {
+  size_t count = msg->count;
+  size_t maxCount = (len - offsetof(ESPNowBatchMsg, samples)) / sizeof(ESPNowBatchSample);
+  if (count > maxCount) count = maxCount;
+  if (count == 0) return;
+
+  // once synced, trace timestamps are moved onto the parent's clock so
+  // every node's samples line up on the same time axis
+  int64_t toParent = 0;
+  bool synced = nodesChildToParentTime(id, 0, &toParent);
+
+  // unsynced samples go into the history as if the newest one was just taken
+  uint32_t rxMs = (uint32_t)(rxTime / 1000);
+  uint32_t lastMs = msg->baseTime + msg->samples[count - 1].dt;
+
+  uint32_t sampleMs = 0;
+  for (size_t i = 0; i < count; i++) {
+    sampleMs = msg->baseTime + msg->samples[i].dt;
+    WeightPoint point;
+    point.timestamp = synced ? (uint32_t)(((int64_t)sampleMs * 1000 + toParent) / 1000) : sampleMs;
+    point.weight = msg->samples[i].weight / ESPNOW_WEIGHT_SCALE;
+    if (id >= 1 && id <= ESPNOW_TRACE_NODES) childTraces[id - 1].push(point);
+    historyRecord(id, synced ? point.timestamp : rxMs - (lastMs - sampleMs), point.weight);
+    if (synced) latencyRecord(LATENCY_SAMPLE_TO_RX, rxTime - ((int64_t)sampleMs * 1000 + toParent));
+  }
+  // latest sample is the current weight
+  nodesSetWeight(id, msg->samples[count - 1].weight / ESPNOW_WEIGHT_SCALE, false);
+  nodesSetTiming(id, rxTime, synced ? (int64_t)sampleMs * 1000 + toParent : 0);
+  ingestDataChanged = true;
+}
+
+// Parent: finish a time-sync exchange (t4 = when the pong arrived)
+static void espnowHandleTimePong(uint8_t id, const ESPNowTimePongMsg *msg, int64_t rxTime) {
+  int64_t t1 = msg->parentTime, t2 = msg->rxTime, t3 = msg->txTime, t4 = rxTime;
+  int64_t rtt = (t4 - t1) - (t3 - t2);
+  if (rtt < 0) return;  // not a pong to one of our pings
+  int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+  nodesUpdateClock(id, offset, (uint32_t)rtt);
+}
+
+// Parent: ping every online child so it stays synced
+static void espnowSendTimePings() {
+  int count = nodesSnapshot(syncSnapshot, MAX_NODES);
+  uint32_t now = millis();
+  for (int i = 0; i < count; i++) {
+    const NodeInfo &node = syncSnapshot[i];
+    if (!nodesIsOnline(node, now) || !espnowEnsurePeer(node.mac)) continue;
+    ESPNowTimePingMsg ping;
+    espnowFillHeader(ping.hdr, MSG_TYPE_TIME_PING);
+    ping.offset = node.clockOffset;
+    ping.offsetValid = node.clockSynced;
+    ping.parentTime = esp_timer_get_time();
+    esp_now_send(node.mac, (uint8_t *)&ping, sizeof(ping));
+  }
+}
+
+// Parent: tell one child the spec class it is judged against
+static void espnowSendSpec(uint8_t id, const uint8_t *mac) {
+  SpecClass spec;
+  if (!specForNode(id, &spec) || !espnowEnsurePeer(mac)) return;
+  ESPNowSpecMsg msg;
+  espnowFillHeader(msg.hdr, MSG_TYPE_SPEC);
+  msg.minWeight = isnan(spec.minWeight) ? INT32_MIN : (int32_t)lroundf(spec.minWeight * ESPNOW_WEIGHT_SCALE);
+  memset(msg.className, 0, sizeof(msg.className));
+  strncpy(msg.className, spec.name, sizeof(msg.className) - 1);
+  esp_now_send(mac, (uint8_t *)&msg, sizeof(msg));
+}
+
+// Parent: push spec classes to every online child when they change, and
+// now and then anyway for children that missed it or rebooted
+static void espnowPushSpecs() {
+  uint32_t version = specVersion();
+  unsigned long now = millis();
+  if (version == sentSpecVersion && now - lastSpecPush < ESPNOW_SPEC_REFRESH_INTERVAL) return;
+  sentSpecVersion = version;
+  lastSpecPush = now;
+
+  int count = nodesSnapshot(syncSnapshot, MAX_NODES);
+  for (int i = 0; i < count; i++) {
+    if (nodesIsOnline(syncSnapshot[i], now)) espnowSendSpec(syncSnapshot[i].id, syncSnapshot[i].mac);
+  }
+}
+
+// Add a unicast peer the first time we talk to it
+static bool espnowEnsurePeer(const uint8_t *mac) {
+  if (esp_now_is_peer_exist(mac)) return true;
+  esp_now_peer_info_t peerInfo = {};
+  memcpy(peerInfo.peer_addr, mac, 6);
+  peerInfo.channel = 0;  // use the current channel
+  peerInfo.encrypt = false;
+  return esp_now_add_peer(&peerInfo) == ESP_OK;
+}
+
+// Child: queue a tare if addressed to this node (or id==0 for broadcast)
+// Returns true if the command was for this node
+static bool espnowHandleTare(uint8_t target) {
+  Serial.print("Received tare command for node id ");
+  Serial.println(target);
+  if (target == identityNodeId() || target == 0) {
+    // mark pending tare (use 1 to indicate tare request)
+    pendingTareCommand = 1;
+    Serial.println("Tare queued");
+    return true;
+  }
+  Serial.println("Tare ignored (not for this node)");
+  return false;
+}
+
+// Child: acknowledge a command back to the sender
+static void espnowSendAck(const uint8_t *mac, uint8_t ackType, uint16_t ackSeq) {
+  if (!espnowEnsurePeer(mac)) return;
+  ESPNowAckMsg ack;
+  espnowFillHeader(ack.hdr, MSG_TYPE_ACK);
+  ack.ackType = ackType;
+  ack.ackSeq = ackSeq;
+  esp_now_send(mac, (uint8_t *)&ack, sizeof(ack));
+}
+
+// Frames from firmware that predates the versioned header
+// (parent: ingest task; child: radio callback)
+static void espnowOnRecvLegacy(const uint8_t *mac_addr, const ESPNowLegacyData *payload) {
+  if (identityIsParent()) {
+    if (payload->type == MSG_TYPE_WEIGHT && nodesTouch(payload->id, mac_addr, 0, false)) {
+      espnowStoreChildWeight(payload->id, MSG_TYPE_WEIGHT, payload->value, 0);
+      // store hostname if present
+      if (payload->name[0] != '\0') {
+        char name[sizeof(payload->name) + 1];
+        memcpy(name, payload->name, sizeof(payload->name));
+        name[sizeof(payload->name)] = '\0';
+        nodesSetName(payload->id, name);
       }
     }
+  } else if (payload->type == MSG_TYPE_TARE) {
+    espnowHandleTare(payload->id);
   }
 }
 
-void espnowSendTare(uint8_t nodeId) {
-  if (!ESPNOW_IS_PARENT) {
-    // Only parent sends commands
+// Parent: give a pairing child its node ID and tell it our channel
+static void espnowHandlePairRequest(const uint8_t *mac_addr, const ESPNowPairRequestMsg *req) {
+  char name[sizeof(req->name) + 1];
+  memcpy(name, req->name, sizeof(req->name));
+  name[sizeof(req->name)] = '\0';
+
+  uint8_t id = identityAssignNodeId(mac_addr, req->hdr.id);
+  if (id == 0) {
+    Serial.print("Pair request from ");
+    Serial.print(name);
+    Serial.println(" refused: no free node IDs");
     return;
   }
-  
-  // Parent node sends tare command to child
-  // For simplicity, send broadcast; in production could look up child MAC
+  if (!espnowEnsurePeer(mac_addr)) return;
+
+  ESPNowPairResponseMsg resp;
+  espnowFillHeader(resp.hdr, MSG_TYPE_PAIR_RESPONSE);
+  memcpy(resp.childMac, mac_addr, 6);
+  resp.nodeId = id;
+  uint8_t primary = 0;
+  wifi_second_chan_t second;
+  esp_wifi_get_channel(&primary, &second);
+  resp.channel = primary;
+  esp_err_t result = esp_now_send(mac_addr, (uint8_t *)&resp, sizeof(resp));
+  if (result != ESP_OK) {
+    Serial.print("Error sending pair response: ");
+    Serial.println(esp_err_to_name(result));
+    return;
+  }
+
+  if (nodesTouch(id, mac_addr, req->hdr.seq, false)) nodesSetName(id, name);
+  espnowSendSpec(id, mac_addr);
+  Serial.print("Paired ");
+  Serial.print(name);
+  Serial.print(" as node ");
+  Serial.println(id);
+}
+
+// Parent: decode one frame from a child and update node state.
+// Runs on the ingest task, never in the radio callback.
+static void espnowHandleChildFrame(const uint8_t *mac_addr, const uint8_t *data, int len, int64_t rxTime) {
+  if (len < (int)sizeof(ESPNowHeader) || data[0] != ESPNOW_MAGIC) {
+    if (len == sizeof(ESPNowLegacyData)) {
+      espnowOnRecvLegacy(mac_addr, (const ESPNowLegacyData *)data);
+    }
+    return;  // not ours
+  }
+
+  const ESPNowHeader *hdr = (const ESPNowHeader *)data;
+  if (hdr->version == 0) return;
+  if (hdr->type == MSG_TYPE_PAIR_REQUEST) {
+    if (len >= (int)sizeof(ESPNowPairRequestMsg)) {
+      espnowHandlePairRequest(mac_addr, (const ESPNowPairRequestMsg *)data);
+    }
+    return;
+  }
+  if (hdr->id == 0) return;
+  if (!nodesTouch(hdr->id, mac_addr, hdr->seq, true)) {
+    debugln("Node registry full, frame from node " + String(hdr->id) + " ignored");
+    return;
+  }
+
+  switch (hdr->type) {
+    case MSG_TYPE_WEIGHT:
+    case MSG_TYPE_SETTLED: {
+      if (len < (int)sizeof(ESPNowWeightMsg)) break;
+      const ESPNowWeightMsg *msg = (const ESPNowWeightMsg *)data;
+      espnowStoreChildWeight(hdr->id, hdr->type, msg->weight / ESPNOW_WEIGHT_SCALE, msg->flags);
+      espnowRecordTiming(hdr->id, msg->timestamp, rxTime);
+      break;
+    }
+    case MSG_TYPE_WEIGHT_BATCH: {
+      if (len < (int)offsetof(ESPNowBatchMsg, samples)) break;
+      espnowStoreChildBatch(hdr->id, (const ESPNowBatchMsg *)data, len, rxTime);
+      break;
+    }
+    case MSG_TYPE_TIME_PONG: {
+      if (len < (int)sizeof(ESPNowTimePongMsg)) break;
+      espnowHandleTimePong(hdr->id, (const ESPNowTimePongMsg *)data, rxTime);
+      break;
+    }
+    case MSG_TYPE_HELLO: {
+      if (len < (int)sizeof(ESPNowHelloMsg)) break;
+      const ESPNowHelloMsg *msg = (const ESPNowHelloMsg *)data;
+      char name[sizeof(msg->name) + 1];
+      memcpy(name, msg->name, sizeof(msg->name));
+      name[sizeof(msg->name)] = '\0';
+      nodesSetName(hdr->id, name);
+      Serial.print("Hello from node ");
+      Serial.print(hdr->id);
+      Serial.print(": ");
+      Serial.println(name);
+      break;
+    }
+    case MSG_TYPE_BATTERY: {
+      if (len < (int)sizeof(ESPNowBatteryMsg)) break;
+      const ESPNowBatteryMsg *msg = (const ESPNowBatteryMsg *)data;
+      nodesSetBattery(hdr->id, msg->millivolts, msg->soc, msg->minutesLeft);
+      break;
+    }
+    case MSG_TYPE_ACK: {
+      if (len < (int)sizeof(ESPNowAckMsg)) break;
+      const ESPNowAckMsg *msg = (const ESPNowAckMsg *)data;
+      AckEvent ack = { hdr->id, msg->ackType, msg->ackSeq, millis() };
+      ackRing.push(ack);  // matched against pending commands in espnowLoop()
+      break;
+    }
+    default:
+      break;  // unknown type from newer firmware
+  }
+}
+
+// Parent: capture the RSSI of ESP-NOW frames. The ESP-NOW receive callback
+// does not report signal strength on this core, so listen promiscuously for
+// Espressif vendor-specific action frames and note the sender's RSSI.
+static void espnowPromiscuousRx(void *buf, wifi_promiscuous_pkt_type_t type) {
+  if (type != WIFI_PKT_MGMT) return;
+  const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+  const uint8_t *frame = pkt->payload;
+  if (pkt->rx_ctrl.sig_len < 28) return;
+  // action frame (0xD0), vendor-specific category (127), Espressif OUI 18:fe:34
+  if (frame[0] != 0xD0 || frame[24] != 127 ||
+      frame[25] != 0x18 || frame[26] != 0xfe || frame[27] != 0x34) return;
+
+  LinkEvent *ev = linkEvents.beginPush();
+  if (ev == nullptr) return;
+  memcpy(ev->mac, frame + 10, 6);  // addr2 = transmitter
+  ev->kind = LINK_EVENT_RSSI;
+  ev->rssi = (int8_t)pkt->rx_ctrl.rssi;
+  linkEvents.commitPush();
+}
+
+// Parent: drain the ingest ring whenever the radio callback signals
+static void espnowIngestTask(void *param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    LinkEvent ev;
+    while (linkEvents.pop(ev)) {
+      if (ev.kind == LINK_EVENT_RSSI) nodesRecordRssi(ev.mac, ev.rssi);
+      else nodesRecordSendFailure(ev.mac);
+    }
+
+    IngestFrame *frame;
+    while ((frame = ingestRing.peek()) != nullptr) {
+      espnowHandleChildFrame(frame->mac, frame->data, frame->len, frame->rxTime);
+      ingestRing.releasePop();
+    }
+    if (ingestDataChanged) {
+      ingestDataChanged = false;
+      if (dataCallback) dataCallback();
+    }
+  }
+}
+
+static void espnowStartIngest() {
+  if (ingestTask != NULL) return;
+  xTaskCreatePinnedToCore(espnowIngestTask, "espnow-rx", ESPNOW_RX_TASK_STACK, NULL,
+                          ESPNOW_RX_TASK_PRIORITY, &ingestTask, ESPNOW_RX_TASK_CORE);
+  if (ingestTask == NULL) Serial.println("Failed to start ESP-NOW ingest task");
+
+  // RSSI per node via promiscuous mode, management frames only
+  wifi_promiscuous_filter_t filter = {};
+  filter.filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT;
+  esp_wifi_set_promiscuous_filter(&filter);
+  esp_wifi_set_promiscuous_rx_cb(espnowPromiscuousRx);
+  esp_wifi_set_promiscuous(true);
+}
+
+// Radio callback (WiFi task). On the parent it only copies the frame into
+// the preallocated ingest ring - no decoding, logging or allocation here.
+void espnowOnRecv(const uint8_t *mac_addr, const uint8_t *data, int len) {
+  if (identityIsParent()) {
+    if (len <= 0 || len > ESP_NOW_MAX_DATA_LEN) return;
+    IngestFrame *frame = ingestRing.beginPush();
+    if (frame == nullptr) return;  // ring full; counted in ingestRing.dropped()
+    frame->rxTime = esp_timer_get_time();
+    memcpy(frame->mac, mac_addr, 6);
+    frame->len = (uint8_t)len;
+    memcpy(frame->data, data, len);
+    ingestRing.commitPush();
+    if (ingestTask != NULL) xTaskNotifyGive(ingestTask);
+    return;
+  }
+
+  if (len < (int)sizeof(ESPNowHeader) || data[0] != ESPNOW_MAGIC) {
+    if (len == sizeof(ESPNowLegacyData)) {
+      espnowOnRecvLegacy(mac_addr, (const ESPNowLegacyData *)data);
+    }
+    return;  // not ours
+  }
+
+  const ESPNowHeader *hdr = (const ESPNowHeader *)data;
+  if (hdr->version == 0) return;
+
+  // Child: a parent answering our pair request (stored for espnowLoop())
+  if (hdr->type == MSG_TYPE_PAIR_RESPONSE && len >= (int)sizeof(ESPNowPairResponseMsg)) {
+    const ESPNowPairResponseMsg *resp = (const ESPNowPairResponseMsg *)data;
+    if (identityIsPaired() || pairResponseReady || memcmp(resp->childMac, ownMac, 6) != 0) return;
+    pairResponse = *resp;
+    memcpy(pairResponseMac, mac_addr, 6);
+    pairResponseReady = true;
+    return;
+  }
+
+  // Child: time-sync ping - answer at once so the round trip stays short,
+  // and take over the offset the parent has worked out for us
+  if (hdr->type == MSG_TYPE_TIME_PING && len >= (int)sizeof(ESPNowTimePingMsg)) {
+    int64_t rxTime = esp_timer_get_time();
+    const ESPNowTimePingMsg *ping = (const ESPNowTimePingMsg *)data;
+    if (ping->offsetValid) {
+      portENTER_CRITICAL(&sharedClockMux);
+      sharedOffset = ping->offset;
+      haveSharedOffset = true;
+      portEXIT_CRITICAL(&sharedClockMux);
+    }
+    if (!espnowEnsurePeer(mac_addr)) return;
+    ESPNowTimePongMsg pong;
+    espnowFillHeader(pong.hdr, MSG_TYPE_TIME_PONG);
+    pong.parentTime = ping->parentTime;
+    pong.rxTime = rxTime;
+    pong.txTime = esp_timer_get_time();
+    esp_now_send(mac_addr, (uint8_t *)&pong, sizeof(pong));
+    return;
+  }
+
+  // Child: spec class to judge settled weights against
+  if (hdr->type == MSG_TYPE_SPEC && len >= (int)sizeof(ESPNowSpecMsg)) {
+    const ESPNowSpecMsg *msg = (const ESPNowSpecMsg *)data;
+    SpecClass spec;
+    spec.minWeight = msg->minWeight == INT32_MIN ? NAN : msg->minWeight / ESPNOW_WEIGHT_SCALE;
+    memcpy(spec.name, msg->className, SPEC_NAME_LEN);
+    spec.name[SPEC_NAME_LEN] = '\0';
+    specSetLocal(spec);
+    return;
+  }
+
+  // Child receiving commands from parent
+  if (hdr->type == MSG_TYPE_TARE && len >= (int)sizeof(ESPNowCommandMsg)) {
+    uint8_t target = ((const ESPNowCommandMsg *)data)->target;
+    if (target != identityNodeId() && target != 0) {
+      espnowHandleTare(target);  // logs and ignores
+      return;
+    }
+    // a retry of a command we already ran only needs a fresh ACK
+    bool duplicate = haveLastCommand && hdr->seq == lastCommandSeq;
+    haveLastCommand = true;
+    lastCommandSeq = hdr->seq;
+    espnowSendAck(mac_addr, MSG_TYPE_TARE, hdr->seq);
+    if (!duplicate) espnowHandleTare(target);
+  }
+}
+
+uint32_t espnowIngestDropped() {
+  return ingestRing.dropped();
+}
+
+void espnowSetCommandResultCallback(ESPNowCommandResultCallback callback) {
+  commandResultCallback = callback;
+}
+
+void espnowSetDataCallback(ESPNowDataCallback callback) {
+  dataCallback = callback;
+}
+
+// Parent: (re)send a pending command, unicast if the child's MAC is known
+static void espnowTransmitCommand(PendingCommand &cmd) {
   uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-  ESPNowData data;
-  data.type = MSG_TYPE_TARE;
-  data.id = nodeId;
-  data.value = 0; // default scale/index
-  data.timestamp = millis();
-  
-  esp_err_t result = esp_now_send(broadcastMac, (uint8_t *)&data, sizeof(data));
+  uint8_t childMac[6];
+  const uint8_t *dest = broadcastMac;
+  if (nodesGetMac(cmd.nodeId, childMac) && espnowEnsurePeer(childMac)) dest = childMac;
+
+  cmd.attempts++;
+  cmd.lastSent = millis();
+  esp_err_t result = esp_now_send(dest, (uint8_t *)&cmd.msg, sizeof(cmd.msg));
   if (result != ESP_OK) {
-    Serial.print("Error sending tare command: ");
+    Serial.print("Error sending command: ");
     Serial.print(result);
     Serial.print(" ("); Serial.print(esp_err_to_name(result)); Serial.println(")");
-  } else {
-    Serial.print("Sent tare command to node ");
-    Serial.print(nodeId);
   }
 }
 
-float espnowGetChildWeight(uint8_t childId) {
-  auto it = childWeights.find(childId);
-  if (it != childWeights.end()) {
-    return it->second;
+// Parent: release a finished command (caller holds commandMutex)
+static CommandResult espnowCompleteCommand(PendingCommand &cmd, bool ok, unsigned long when) {
+  cmd.active = false;
+  CommandResult result = {cmd.nodeId, cmd.msg.hdr.type, ok, (uint32_t)(when - cmd.firstSent), cmd.attempts};
+  return result;
+}
+
+// Parent: match ACKs and retry unacknowledged commands with backoff
+static void espnowServiceCommands() {
+  CommandResult results[ESPNOW_MAX_PENDING];
+  int resultCount = 0;
+
+  xSemaphoreTake(commandMutex, portMAX_DELAY);
+  AckEvent ack;
+  while (ackRing.pop(ack)) {
+    for (int i = 0; i < ESPNOW_MAX_PENDING; i++) {
+      PendingCommand &cmd = pendingCommands[i];
+      if (cmd.active && cmd.nodeId == ack.nodeId &&
+          cmd.msg.hdr.seq == ack.ackSeq && cmd.msg.hdr.type == ack.ackType) {
+        results[resultCount++] = espnowCompleteCommand(cmd, true, ack.receivedAt);
+      }
+    }
+  }
+
+  unsigned long now = millis();
+  for (int i = 0; i < ESPNOW_MAX_PENDING; i++) {
+    PendingCommand &cmd = pendingCommands[i];
+    if (!cmd.active) continue;
+    uint32_t backoff = (uint32_t)ESPNOW_RETRY_BASE_MS << (cmd.attempts - 1);
+    if (backoff > ESPNOW_RETRY_MAX_MS) backoff = ESPNOW_RETRY_MAX_MS;
+    if (now - cmd.lastSent < backoff) continue;
+    if (cmd.attempts >= ESPNOW_MAX_ATTEMPTS) {
+      results[resultCount++] = espnowCompleteCommand(cmd, false, now);
+    } else {
+      espnowTransmitCommand(cmd);
+    }
+  }
+  xSemaphoreGive(commandMutex);
+
+  // each slot completes at most once per pass, so results cannot overflow
+  for (int i = 0; i < resultCount; i++) {
+    const CommandResult &r = results[i];
+    Serial.print("Command to node ");
+    Serial.print(r.nodeId);
+    Serial.print(r.ok ? " acknowledged in " : " failed after ");
+    Serial.print(r.rtt);
+    Serial.print(" ms, attempts: ");
+    Serial.println(r.attempts);
+    if (commandResultCallback) {
+      commandResultCallback(r.nodeId, r.type, r.ok, r.rtt, r.attempts);
+    }
   }
-  return NAN;
 }
 
-void espnowForEachChildWeight(void (*callback)(uint8_t childId, float weight)) {
-  // Iterate through the map and call the callback for each child node
-  for (auto& pair : childWeights) {
-    if (callback) {
-      callback(pair.first, pair.second);
+bool espnowSendTare(uint8_t nodeId) {
+  if (!identityIsParent()) {
+    // Only parent sends commands
+    return false;
+  }
+
+  xSemaphoreTake(commandMutex, portMAX_DELAY);
+  // a tare already in flight to this node covers this request too
+  PendingCommand *slot = nullptr;
+  for (int i = 0; i < ESPNOW_MAX_PENDING; i++) {
+    PendingCommand &cmd = pendingCommands[i];
+    if (cmd.active && cmd.nodeId == nodeId && cmd.msg.hdr.type == MSG_TYPE_TARE) {
+      xSemaphoreGive(commandMutex);
+      return true;
     }
+    if (!cmd.active && slot == nullptr) slot = &cmd;
+  }
+  if (slot == nullptr) {
+    xSemaphoreGive(commandMutex);
+    Serial.println("Too many commands pending, tare dropped");
+    // tell the page this node was not tared
+    if (commandResultCallback) commandResultCallback(nodeId, MSG_TYPE_TARE, false, 0, 0);
+    return false;
   }
+
+  slot->active = true;
+  slot->nodeId = nodeId;
+  slot->attempts = 0;
+  slot->firstSent = millis();
+  espnowFillHeader(slot->msg.hdr, MSG_TYPE_TARE);
+  slot->msg.target = nodeId;
+  espnowTransmitCommand(*slot);
+  xSemaphoreGive(commandMutex);
+
+  Serial.print("Sent tare command to node ");
+  Serial.println(nodeId);
+  return true;
+}
+
+int espnowSendTareAll() {
+  // snapshot the known IDs so no lock is held while sending
+  uint8_t ids[MAX_NODES];
+  int count = nodesListIds(ids, MAX_NODES);
+
+  int sent = 0;
+  for (int i = 0; i < count; i++) {
+    if (espnowSendTare(ids[i])) sent++;
+  }
+  if (sent == 0) Serial.println("No child nodes heard from yet, nothing to tare");
+  return sent;
 }
 
 uint8_t espnowGetPendingTareCommand() {
@@ -205,108 +832,256 @@ uint8_t espnowGetPendingTareCommand() {
   return cmd;
 }
 
-void espnowLoop() {
-  // ESP-NOW operates via callbacks, so nothing needed here currently
-  // Could be used for periodic tasks in the future
+// Child: one step of the pairing search - hop to the next channel and
+// broadcast a request. Called from espnowLoop() while unpaired.
+static void espnowPairStep() {
+  unsigned long now = millis();
+  if (lastPairAttempt != 0 && now - lastPairAttempt < ESPNOW_PAIR_DWELL_MS) return;
+  if (lastPairAttempt != 0) {
+    pairChannel = (pairChannel % ESPNOW_PAIR_MAX_CHANNEL) + 1;
+    esp_wifi_set_channel(pairChannel, WIFI_SECOND_CHAN_NONE);
+  }
+  lastPairAttempt = now;
+
+  uint8_t broadcastMac[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  ESPNowPairRequestMsg req;
+  espnowFillHeader(req.hdr, MSG_TYPE_PAIR_REQUEST);  // hdr.id = the ID we'd like
+  memset(req.name, 0, sizeof(req.name));
+  strncpy(req.name, identityName(), sizeof(req.name) - 1);
+  esp_now_send(broadcastMac, (uint8_t *)&req, sizeof(req));
 }
 
-void espnowBufferWeight(float weight) {
-  if (ESPNOW_IS_PARENT || bufferIndex >= 100) {
-    return;  // Parent doesn't buffer, or buffer is full
+// Child: pairing state machine
+static void espnowServicePairing() {
+  if (pairResponseReady) {
+    uint8_t mac[6];
+    memcpy(mac, pairResponseMac, 6);
+    uint8_t id = pairResponse.nodeId;
+    uint8_t channel = pairResponse.channel;
+    pairResponseReady = false;
+
+    if (channel != pairChannel) {
+      pairChannel = channel;
+      esp_wifi_set_channel(pairChannel, WIFI_SECOND_CHAN_NONE);
+    }
+    identitySetPairing(mac, channel, id);
+    espnowEnsurePeer(mac);
+    parentSendFailures = 0;
+    lastHelloTime = 0;  // announce straight away
+    lastBatteryTime = 0;
+    Serial.print("Paired with parent on channel ");
+    Serial.print(channel);
+    Serial.print(" as node ");
+    Serial.println(id);
+  }
+
+  if (!identityIsPaired()) {
+    espnowPairStep();
+    return;
+  }
+
+  // the parent has stopped answering (moved channel, replaced): search again
+  if (parentSendFailures >= ESPNOW_PAIR_LOST_FAILURES) {
+    uint8_t mac[6];
+    if (identityGetParentMac(mac)) esp_now_del_peer(mac);
+    identityClearPairing();
+    parentSendFailures = 0;
+    lastPairAttempt = 0;
+    Serial.println("Lost the parent - pairing again");
   }
-  
-  weightBuffer[bufferIndex++] = weight;
 }
 
-void espnowSendAveragedWeightIfReady() {
-  if (ESPNOW_IS_PARENT) {
-    return;  // Parent doesn't send weight data
+bool espnowSharedTime(int64_t *us) {
+  int64_t now = esp_timer_get_time();
+  if (identityIsParent()) {
+    *us = now;
+    return true;
   }
-  
-  unsigned long currentTime = millis();
-  
-  // Check if interval has elapsed since last send
-  if (currentTime - lastSendTime >= ESPNOW_SEND_INTERVAL && bufferIndex > 0) {
-    lastSendTime = currentTime;
-    
-    // Calculate average
-    float sum = 0.0f;
-    for (int i = 0; i < bufferIndex; i++) {
-      sum += weightBuffer[i];
-    }
-    float average = sum / bufferIndex;
-    
-    // Reset buffer
-    bufferIndex = 0;
-    
-    // Send the average
-    uint8_t parentMac[] = PARENT_MAC_ADDR;
-    ESPNowData data;
-    data.type = MSG_TYPE_WEIGHT;
-    data.id = DEVICE_ID;
-    data.value = average;
-    data.timestamp = currentTime;
-    // include hostname
-    memset(data.name, 0, sizeof(data.name));
-    const char *hn = HOSTNAME;
-    if (hn) strncpy(data.name, hn, sizeof(data.name) - 1);
-    
-    // Serial.println("Sending averaged weight: ");
-    Serial.print("Sending: Node ID ");
-    Serial.print(DEVICE_ID);
-    Serial.print(" - ");
-    Serial.print(data.name);
-    Serial.print(": ");
-    Serial.print(average, 1); 
-    Serial.println(" g");
+  portENTER_CRITICAL(&sharedClockMux);
+  bool ok = haveSharedOffset;
+  int64_t offset = sharedOffset;
+  portEXIT_CRITICAL(&sharedClockMux);
+  if (ok) *us = now - offset;
+  return ok;
+}
+
+// Child: which ESPNOW_BATCH_INTERVAL slot of the time grid a sample taken
+// at `childMs` falls in. Uses the parent's time base once synced.
+static int64_t espnowBatchSlot(uint32_t childMs) {
+  int64_t ms = childMs;
+  portENTER_CRITICAL(&sharedClockMux);
+  if (haveSharedOffset) ms -= sharedOffset / 1000;
+  portEXIT_CRITICAL(&sharedClockMux);
+  return ms / ESPNOW_BATCH_INTERVAL;
+}
 
-    esp_err_t result = esp_now_send(parentMac, (uint8_t *)&data, sizeof(data));
-    if (result != ESP_OK) {
-      Serial.print("Error sending weight data: ");
-      Serial.println(result);
+bool espnowIsPaired() {
+  return identityIsParent() || identityIsPaired();
+}
+
+void espnowLoop() {
+  if (identityIsParent()) {
+    espnowServiceCommands();
+    nodesExpire();  // free the slots of nodes that have gone quiet for good
+    unsigned long now = millis();
+    if (now - lastTimeSync >= ESPNOW_TIMESYNC_INTERVAL) {
+      lastTimeSync = now;
+      espnowSendTimePings();
     }
+    espnowPushSpecs();
+    return;
+  }
+
+  espnowServicePairing();
+  if (!identityIsPaired()) return;
+
+  // Child: send a partial batch once its slot of the time grid has passed
+  if (pendingBatchCount > 0 && espnowBatchSlot(millis()) != pendingBatchSlot) {
+    espnowFlushBatch();
+  }
+
+  // Child: re-announce the hostname now and then in case the parent restarted
+  unsigned long now = millis();
+  if (lastHelloTime == 0 || now - lastHelloTime >= ESPNOW_HELLO_INTERVAL) {
+    lastHelloTime = now;
+    espnowSendHello();
+  }
+
+  // Child: battery state, so the parent knows which scale needs a swap
+  if (lastBatteryTime == 0 || now - lastBatteryTime >= ESPNOW_BATTERY_INTERVAL) {
+    lastBatteryTime = now;
+    espnowSendBattery();
   }
 }
 
-void espnowSendWeight(float weight) {
-  if (ESPNOW_IS_PARENT) {
+void espnowQueueBatchSample(uint32_t timestamp, float weight) {
+  if (identityIsParent()) return;
+
+  // batches cover one ESPNOW_BATCH_INTERVAL slot of the shared time grid,
+  // so every child's frames hold samples from the same instants
+  int64_t slot = espnowBatchSlot(timestamp);
+  if (pendingBatchCount > 0 && slot != pendingBatchSlot) {
+    espnowFlushBatch();
+  }
+  if (pendingBatchCount == 0) {
+    pendingBatch.baseTime = timestamp;
+    pendingBatchSlot = slot;
+  }
+
+  ESPNowBatchSample &sample = pendingBatch.samples[pendingBatchCount++];
+  sample.dt = (uint16_t)(timestamp - pendingBatch.baseTime);
+  sample.weight = (int32_t)lroundf(weight * ESPNOW_WEIGHT_SCALE);
+
+  if (pendingBatchCount >= ESPNOW_BATCH_MAX) {
+    espnowFlushBatch();
+  }
+}
+
+void espnowFlushBatch() {
+  if (identityIsParent() || pendingBatchCount == 0) return;
+
+  uint8_t parentMac[6];
+  if (!identityGetParentMac(parentMac)) {
+    pendingBatchCount = 0;  // nobody to send to yet
+    return;
+  }
+  espnowFillHeader(pendingBatch.hdr, MSG_TYPE_WEIGHT_BATCH);
+  pendingBatch.count = pendingBatchCount;
+  size_t len = offsetof(ESPNowBatchMsg, samples) + pendingBatchCount * sizeof(ESPNowBatchSample);
+  pendingBatchCount = 0;
+
+  esp_err_t result = esp_now_send(parentMac, (uint8_t *)&pendingBatch, len);
+  if (result != ESP_OK) {
+    Serial.print("Error sending weight batch: ");
+    Serial.println(result);
+  }
+}
+
+size_t espnowPeekChildTrace(uint8_t childId, WeightPoint *out, size_t maxPoints) {
+  if (childId < 1 || childId > ESPNOW_TRACE_NODES) return 0;
+  return childTraces[childId - 1].peekMany(out, maxPoints);
+}
+
+void espnowReleaseChildTrace(uint8_t childId, size_t count) {
+  if (childId < 1 || childId > ESPNOW_TRACE_NODES || count == 0) return;
+  childTraces[childId - 1].releasePop(count);
+}
+
+void espnowSendHello() {
+  uint8_t parentMac[6];
+  if (identityIsParent() || !identityGetParentMac(parentMac)) return;
+
+  ESPNowHelloMsg msg;
+  espnowFillHeader(msg.hdr, MSG_TYPE_HELLO);
+  memset(msg.name, 0, sizeof(msg.name));
+  strncpy(msg.name, identityName(), sizeof(msg.name) - 1);
+
+  esp_err_t result = esp_now_send(parentMac, (uint8_t *)&msg, sizeof(msg));
+  if (result != ESP_OK) {
+    Serial.print("Error sending hello: ");
+    Serial.println(result);
+  }
+}
+
+void espnowSendBattery() {
+  uint8_t parentMac[6];
+  if (identityIsParent() || !identityGetParentMac(parentMac)) return;
+
+  BatteryStatus battery = batteryStatus();
+  ESPNowBatteryMsg msg;
+  espnowFillHeader(msg.hdr, MSG_TYPE_BATTERY);
+  msg.millivolts = isnan(battery.voltage) ? 0 : (uint16_t)lroundf(battery.voltage * 1000.0f);
+  msg.soc = battery.soc;
+  msg.minutesLeft = battery.minutesLeft;
+
+  esp_err_t result = esp_now_send(parentMac, (uint8_t *)&msg, sizeof(msg));
+  if (result != ESP_OK) {
+    Serial.print("Error sending battery: ");
+    Serial.println(result);
+  }
+}
+
+// Build and send a weight-carrying message to the parent (child only)
+static void espnowSendWeightMessage(uint8_t type, float weight, uint8_t flags, uint32_t timestamp) {
+  if (identityIsParent()) {
     return;  // Parent doesn't send weight data
   }
+
+  uint8_t parentMac[6];
+  if (!identityGetParentMac(parentMac)) return;  // still pairing
+
+  ESPNowWeightMsg msg;
+  espnowFillHeader(msg.hdr, type);
+  msg.weight = (int32_t)lroundf(weight * ESPNOW_WEIGHT_SCALE);
+  msg.timestamp = timestamp;  // sample time, so the parent's latency figures include the wait to send
+  msg.flags = flags;
   
-  uint8_t parentMac[] = PARENT_MAC_ADDR;
-  ESPNowData data;
-  data.type = MSG_TYPE_WEIGHT;
-  data.id = DEVICE_ID;
-  data.value = weight;
-  data.timestamp = millis();
-  // include hostname
-  memset(data.name, 0, sizeof(data.name));
-  const char *hn = HOSTNAME;
-  if (hn) strncpy(data.name, hn, sizeof(data.name) - 1);
-  
-  // Serial.println("Sending averaged weight: ");
-  Serial.print("Sending: Node ID ");
-  Serial.print(DEVICE_ID);
-  Serial.print(" - ");
-  Serial.print(data.name);
+  Serial.print(type == MSG_TYPE_SETTLED ? "Sending settled: Node ID " : "Sending: Node ID ");
+  Serial.print(identityNodeId());
   Serial.print(": ");
   Serial.print(weight, 1); 
   Serial.println(" g");
 
-  esp_err_t result = esp_now_send(parentMac, (uint8_t *)&data, sizeof(data));
+  esp_err_t result = esp_now_send(parentMac, (uint8_t *)&msg, sizeof(msg));
   if (result != ESP_OK) {
     Serial.print("Error sending weight data: ");
     Serial.println(result);
   }
 }
 
+void espnowSendWeight(float weight, uint32_t timestamp) {
+  espnowSendWeightMessage(MSG_TYPE_WEIGHT, weight, 0, timestamp);
+}
 
+void espnowSendSettledWeight(float weight, uint8_t verdict, uint32_t timestamp) {
+  uint8_t flags = ESPNOW_WEIGHT_FLAG_SETTLED;
+  if (verdict != SPEC_VERDICT_NONE) flags |= ESPNOW_WEIGHT_FLAG_HAS_VERDICT;
+  if (verdict == SPEC_VERDICT_PASS) flags |= ESPNOW_WEIGHT_FLAG_PASS;
+  espnowSendWeightMessage(MSG_TYPE_SETTLED, weight, flags, timestamp);
+}
 
-
-const char* espnowGetChildName(uint8_t childId) {
-  auto it = childNames.find(childId);
-  if (it != childNames.end()) return it->second.c_str();
-  return "";
+bool espnowNextWeighIn(ESPNowWeighIn *out) {
+  return weighIns.pop(*out);
 }
 
 void espnowPrintPeers() {
@@ -0,0 +1,121 @@
+#include "history.h"
+#include "config.h"
+#include "weight-frame.h"
+#include "espnow.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// One ring per node, indexed by slot number (timeMs / HISTORY_STEP_MS)
+// modulo HISTORY_POINTS. The slot being filled is kept as a running sum
+// and written into the ring when time moves on to the next slot.
+struct NodeHistory {
+  uint8_t id;             // 0 = unused
+  bool hasData;
+  uint32_t newestSlot;    // slot number of the slot being filled
+  float sum;              // running sum for newestSlot
+  uint16_t count;
+  int32_t points[HISTORY_POINTS];
+};
+
+// Written by the ESP-NOW ingest task, read by the web server
+static NodeHistory histories[MAX_NODES];
+static SemaphoreHandle_t historyMutex = NULL;
+
+void historyInit() {
+  if (historyMutex == NULL) historyMutex = xSemaphoreCreateMutex();
+  memset(histories, 0, sizeof(histories));
+}
+
+// Find (or claim) the ring for a node. A ring whose newest data has left
+// the window can be taken over. Caller holds the lock.
+static NodeHistory *historyFor(uint8_t id, uint32_t slot) {
+  NodeHistory *unused = nullptr;
+  for (int i = 0; i < MAX_NODES; i++) {
+    NodeHistory &h = histories[i];
+    if (h.id == id) return &h;
+    if (unused != nullptr) continue;
+    if (h.id == 0 || (h.hasData && slot > h.newestSlot && slot - h.newestSlot >= HISTORY_POINTS)) unused = &h;
+  }
+  if (unused != nullptr) {
+    memset(unused, 0, sizeof(*unused));
+    unused->id = id;
+  }
+  return unused;
+}
+
+static int32_t historyMean(const NodeHistory &h) {
+  return (int32_t)lroundf(h.sum / h.count * ESPNOW_WEIGHT_SCALE);
+}
+
+void historyRecord(uint8_t id, uint32_t timeMs, float weight) {
+  if (id == 0 || isnan(weight) || historyMutex == NULL) return;
+  uint32_t slot = timeMs / HISTORY_STEP_MS;
+
+  xSemaphoreTake(historyMutex, portMAX_DELAY);
+  NodeHistory *h = historyFor(id, slot);
+  if (h == nullptr) {
+    xSemaphoreGive(historyMutex);
+    return;
+  }
+
+  if (!h->hasData) {
+    for (int i = 0; i < HISTORY_POINTS; i++) h->points[i] = HISTORY_GAP;
+    h->hasData = true;
+    h->newestSlot = slot;
+  } else if (slot > h->newestSlot) {
+    // close the finished slot and mark any silent slots in between as gaps
+    h->points[h->newestSlot % HISTORY_POINTS] = historyMean(*h);
+    uint32_t gap = slot - h->newestSlot - 1;
+    if (gap > HISTORY_POINTS) gap = HISTORY_POINTS;
+    for (uint32_t i = 1; i <= gap; i++) h->points[(h->newestSlot + i) % HISTORY_POINTS] = HISTORY_GAP;
+    h->newestSlot = slot;
+    h->sum = 0;
+    h->count = 0;
+  } else if (slot < h->newestSlot) {
+    // late sample for a slot that is already closed: leave it as it was
+    xSemaphoreGive(historyMutex);
+    return;
+  }
+  h->sum += weight;
+  h->count++;
+  xSemaphoreGive(historyMutex);
+}
+
+size_t historyEncodeHeader(uint8_t *buf, size_t cap) {
+  WeightFrameWriter w(buf, cap);
+  w.put8(HISTORY_MAGIC);
+  w.put8(HISTORY_VERSION);
+  w.put32(millis());
+  w.put16(HISTORY_STEP_MS);
+  return w.overflow ? 0 : w.len;
+}
+
+int historyEncodeNode(int index, uint8_t *buf, size_t cap) {
+  if (index >= MAX_NODES) return -1;
+  if (cap < HISTORY_BLOCK_MAX) return 0;
+
+  xSemaphoreTake(historyMutex, portMAX_DELAY);
+  const NodeHistory &h = histories[index];
+  if (h.id == 0 || !h.hasData) {
+    xSemaphoreGive(historyMutex);
+    return 0;
+  }
+
+  char name[NODE_NAME_LEN + 1] = "";
+  nodesGetName(h.id, name);
+  size_t nameLen = strnlen(name, NODE_NAME_LEN);
+
+  // oldest slot first; the slot being filled goes last as its running mean
+  WeightFrameWriter w(buf, cap);
+  w.put8(h.id);
+  w.put8(nameLen);
+  w.putBytes(name, nameLen);
+  w.put32(h.newestSlot * HISTORY_STEP_MS);
+  w.put16(HISTORY_POINTS);
+  for (uint32_t i = 1; i < HISTORY_POINTS; i++) {
+    w.put32((uint32_t)h.points[(h.newestSlot + i) % HISTORY_POINTS]);
+  }
+  w.put32((uint32_t)(h.count > 0 ? historyMean(h) : HISTORY_GAP));
+  xSemaphoreGive(historyMutex);
+  return (int)w.len;
+}
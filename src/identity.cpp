@@ -0,0 +1,346 @@
+#include "identity.h"
+#include "config.h"
+#include <Preferences.h>
+#include <esp_system.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static Preferences identityPrefs;
+static const char *IDENTITY_NAMESPACE = "identity";
+
+// Cached copy of what is stored in NVS
+static bool isParent = IDENTITY_DEFAULT_PARENT;
+static uint8_t nodeId = 0;
+static char nodeName[IDENTITY_NAME_LEN + 1];
+static float calibration = IDENTITY_DEFAULT_CALIBRATION;
+static uint8_t filterProfile = 0;
+static bool paired = false;
+static uint8_t parentMac[6];
+static uint8_t channel = ESPNOW_CHANNEL;
+
+// Parent: MAC -> node ID assignments handed out by the pairing handshake,
+// stored as one blob. Written from the ingest task, cleared from loop().
+struct PairAssignment {
+  uint8_t mac[6];
+  uint8_t id;     // 0 = unused entry
+};
+static PairAssignment assignments[MAX_NODES];
+static SemaphoreHandle_t assignMutex = NULL;
+
+#ifdef IDENTITY_SEED_ID
+// The profiles of the old DEVICE_ID builds, stored once on first boot
+struct IdentitySeed {
+  bool parent;
+  const char *name;
+  float calibration;
+  uint8_t filterProfile;   // SCALE_FILTER_PROFILE_n matching the old chain
+};
+static const IdentitySeed IDENTITY_SEEDS[] = {
+  { true,  IDENTITY_DEFAULT_PARENT_NAME, IDENTITY_DEFAULT_CALIBRATION, 0 },
+  { false, "Yellow", 2128.66f, 0 },
+  { false, "Grey",   1979.4f,  0 },
+  { false, "Purple", 2000.0f,  1 },
+  { false, "Black",  1106.69f, 2 },
+};
+static_assert(IDENTITY_SEED_ID >= 0 &&
+              IDENTITY_SEED_ID < sizeof(IDENTITY_SEEDS) / sizeof(IDENTITY_SEEDS[0]),
+              "IDENTITY_SEED_ID must be 0-4");
+
+// First boot of a migrated node: nothing in NVS yet, store the seed
+static void identitySeed() {
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  if (!identityPrefs.isKey("parent")) {
+    const IdentitySeed &seed = IDENTITY_SEEDS[IDENTITY_SEED_ID];
+    identityPrefs.putBool("parent", seed.parent);
+    identityPrefs.putString("name", seed.name);
+    identityPrefs.putFloat("cal", seed.calibration);
+    identityPrefs.putUChar("filter", seed.filterProfile);
+    if (!seed.parent) identityPrefs.putUChar("id", IDENTITY_SEED_ID);
+    Serial.print("Identity: seeded from profile ");
+    Serial.println(IDENTITY_SEED_ID);
+  }
+  identityPrefs.end();
+}
+#endif
+
+// Serial provisioning line buffer
+static char serialLine[64];
+static size_t serialLen = 0;
+
+static void identityDefaultName(char *out) {
+  if (isParent) {
+    strncpy(out, IDENTITY_DEFAULT_PARENT_NAME, IDENTITY_NAME_LEN);
+    out[IDENTITY_NAME_LEN] = '\0';
+    return;
+  }
+  // children are named after the end of their MAC until provisioned
+  uint8_t mac[6];
+  esp_read_mac(mac, ESP_MAC_WIFI_STA);
+  snprintf(out, IDENTITY_NAME_LEN + 1, "scale-%02x%02x", mac[4], mac[5]);
+}
+
+void identityInit() {
+  if (assignMutex == NULL) assignMutex = xSemaphoreCreateMutex();
+
+#ifdef IDENTITY_SEED_ID
+  identitySeed();
+#endif
+
+  identityPrefs.begin(IDENTITY_NAMESPACE, true);
+  bool provisioned = identityPrefs.isKey("parent");
+  isParent = identityPrefs.getBool("parent", IDENTITY_DEFAULT_PARENT);
+  nodeId = identityPrefs.getUChar("id", 0);
+  calibration = identityPrefs.getFloat("cal", IDENTITY_DEFAULT_CALIBRATION);
+  filterProfile = identityPrefs.getUChar("filter", 0);
+  channel = identityPrefs.getUChar("channel", ESPNOW_CHANNEL);
+  paired = identityPrefs.getBytes("parentMac", parentMac, 6) == 6;
+  size_t nameLen = identityPrefs.getString("name", nodeName, sizeof(nodeName));
+  memset(assignments, 0, sizeof(assignments));
+  if (isParent) identityPrefs.getBytes("pairs", assignments, sizeof(assignments));
+  identityPrefs.end();
+
+  if (nameLen <= 1) identityDefaultName(nodeName);  // length includes the NUL
+  if (isParent) nodeId = 0;
+  paired = paired && nodeId != 0;
+
+  Serial.print("Identity: ");
+  Serial.print(isParent ? "parent" : "child");
+  Serial.print(" \"");
+  Serial.print(nodeName);
+  Serial.print("\"");
+  if (!isParent) {
+    Serial.print(", id ");
+    Serial.print(nodeId);
+    Serial.print(paired ? ", paired on channel " : ", not paired");
+    if (paired) Serial.print(channel);
+  }
+  Serial.println();
+  if (!provisioned) {
+    Serial.println("Identity: not provisioned, running as a default child. Set it up over");
+    Serial.println("serial (role / name / cal, see \"help\") or flash once with -DIDENTITY_SEED_ID=n");
+  }
+}
+
+bool identityIsParent() { return isParent; }
+uint8_t identityNodeId() { return nodeId; }
+const char *identityName() { return nodeName; }
+float identityCalibration() { return calibration; }
+uint8_t identityFilterProfile() { return filterProfile; }
+bool identityIsPaired() { return paired; }
+uint8_t identityChannel() { return channel; }
+
+bool identityGetParentMac(uint8_t *mac) {
+  if (!paired) return false;
+  memcpy(mac, parentMac, 6);
+  return true;
+}
+
+void identitySetRole(bool parent) {
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.putBool("parent", parent);
+  identityPrefs.end();
+}
+
+void identitySetNodeId(uint8_t id) {
+  nodeId = id;
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.putUChar("id", id);
+  identityPrefs.end();
+}
+
+void identitySetName(const char *name) {
+  strncpy(nodeName, name, IDENTITY_NAME_LEN);
+  nodeName[IDENTITY_NAME_LEN] = '\0';
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.putString("name", nodeName);
+  identityPrefs.end();
+}
+
+void identitySetCalibration(float factor) {
+  calibration = factor;
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.putFloat("cal", factor);
+  identityPrefs.end();
+}
+
+void identitySetFilterProfile(uint8_t profile) {
+  filterProfile = profile;
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.putUChar("filter", profile);
+  identityPrefs.end();
+}
+
+void identitySetPairing(const uint8_t *mac, uint8_t newChannel, uint8_t id) {
+  memcpy(parentMac, mac, 6);
+  channel = newChannel;
+  nodeId = id;
+  paired = true;
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.putBytes("parentMac", parentMac, 6);
+  identityPrefs.putUChar("channel", channel);
+  identityPrefs.putUChar("id", id);
+  identityPrefs.end();
+}
+
+void identityClearPairing() {
+  paired = false;
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.remove("parentMac");
+  identityPrefs.end();
+}
+
+uint8_t identityAssignNodeId(const uint8_t *mac, uint8_t requested) {
+  if (requested > MAX_NODES) requested = 0;  // only IDs the parent can track
+
+  xSemaphoreTake(assignMutex, portMAX_DELAY);
+  uint8_t id = 0;
+  bool changed = false;
+  int freeEntry = -1;
+  bool used[MAX_NODES + 1] = {false};
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (assignments[i].id == 0) {
+      if (freeEntry < 0) freeEntry = i;
+      continue;
+    }
+    if (memcmp(assignments[i].mac, mac, 6) == 0) id = assignments[i].id;
+    if (assignments[i].id <= MAX_NODES) used[assignments[i].id] = true;
+  }
+
+  if (id == 0 && freeEntry >= 0) {
+    if (requested != 0 && !used[requested]) {
+      id = requested;
+    } else {
+      for (uint8_t candidate = 1; candidate <= MAX_NODES; candidate++) {
+        if (!used[candidate]) { id = candidate; break; }
+      }
+    }
+    if (id != 0) {
+      memcpy(assignments[freeEntry].mac, mac, 6);
+      assignments[freeEntry].id = id;
+      changed = true;
+    }
+  }
+
+  if (changed) {
+    identityPrefs.begin(IDENTITY_NAMESPACE, false);
+    identityPrefs.putBytes("pairs", assignments, sizeof(assignments));
+    identityPrefs.end();
+  }
+  xSemaphoreGive(assignMutex);
+  return id;
+}
+
+void identityClearAssignments() {
+  xSemaphoreTake(assignMutex, portMAX_DELAY);
+  memset(assignments, 0, sizeof(assignments));
+  identityPrefs.begin(IDENTITY_NAMESPACE, false);
+  identityPrefs.remove("pairs");
+  identityPrefs.end();
+  xSemaphoreGive(assignMutex);
+}
+
+static void identityPrintHelp() {
+  Serial.println("Identity commands:");
+  Serial.println("  show                 print this node's identity");
+  Serial.println("  role parent|child    set the role (reboot to apply)");
+  Serial.println("  id <1-" + String(MAX_NODES) + ">            node ID to request when pairing");
+  Serial.println("  name <text>          hostname / display name");
+  Serial.println("  cal <factor>         HX711 calibration factor");
+  Serial.println("  filter <0-" + String(SCALE_FILTER_PROFILES - 1) + ">         filter profile");
+  Serial.println("  unpair               child: forget the parent and pair again");
+  Serial.println("                       parent: forget every assigned ID");
+  Serial.println("  reboot");
+}
+
+static void identityPrintShow() {
+  Serial.print("role: ");
+  Serial.println(isParent ? "parent" : "child");
+  Serial.print("name: ");
+  Serial.println(nodeName);
+  if (isParent) return;
+  Serial.print("id: ");
+  Serial.println(nodeId);
+  Serial.print("calibration: ");
+  Serial.println(calibration, 2);
+  Serial.print("filter profile: ");
+  Serial.println(filterProfile);
+  if (paired) {
+    Serial.printf("parent: %02x:%02x:%02x:%02x:%02x:%02x channel %u\n",
+                  parentMac[0], parentMac[1], parentMac[2],
+                  parentMac[3], parentMac[4], parentMac[5], channel);
+  } else {
+    Serial.println("parent: not paired");
+  }
+}
+
+static void identityRunCommand(char *line) {
+  char *arg = strchr(line, ' ');
+  if (arg) {
+    *arg++ = '\0';
+    while (*arg == ' ') arg++;
+  } else {
+    arg = line + strlen(line);
+  }
+
+  if (strcmp(line, "show") == 0) {
+    identityPrintShow();
+  } else if (strcmp(line, "role") == 0) {
+    if (strcmp(arg, "parent") == 0 || strcmp(arg, "child") == 0) {
+      identitySetRole(strcmp(arg, "parent") == 0);
+      Serial.println("Role saved, reboot to apply");
+    } else {
+      Serial.println("Usage: role parent|child");
+    }
+  } else if (strcmp(line, "id") == 0) {
+    int id = atoi(arg);
+    if (id < 1 || id > MAX_NODES) {
+      Serial.println("Usage: id <1-" + String(MAX_NODES) + ">");
+      return;
+    }
+    identitySetNodeId(id);
+    identityClearPairing();  // ask the parent for the new ID
+    Serial.println("ID saved, pairing again");
+  } else if (strcmp(line, "name") == 0) {
+    if (*arg == '\0') { Serial.println("Usage: name <text>"); return; }
+    identitySetName(arg);
+    Serial.println("Name saved");
+  } else if (strcmp(line, "cal") == 0) {
+    float factor = atof(arg);
+    if (factor == 0.0f) { Serial.println("Usage: cal <factor>"); return; }
+    identitySetCalibration(factor);
+    Serial.println("Calibration saved, reboot to apply");
+  } else if (strcmp(line, "filter") == 0) {
+    int profile = atoi(arg);
+    if (*arg == '\0' || profile < 0 || profile >= SCALE_FILTER_PROFILES) {
+      Serial.println("Usage: filter <0-" + String(SCALE_FILTER_PROFILES - 1) + ">");
+      return;
+    }
+    identitySetFilterProfile(profile);
+    Serial.println("Filter profile saved");
+  } else if (strcmp(line, "unpair") == 0) {
+    if (isParent) identityClearAssignments(); else identityClearPairing();
+    Serial.println(isParent ? "Assignments cleared" : "Pairing cleared");
+  } else if (strcmp(line, "reboot") == 0) {
+    ESP.restart();
+  } else if (strcmp(line, "help") == 0) {
+    identityPrintHelp();
+  } else {
+    Serial.print("Unknown command: ");
+    Serial.println(line);
+    identityPrintHelp();
+  }
+}
+
+void identityHandleSerial() {
+  while (Serial.available() > 0) {
+    char c = (char)Serial.read();
+    if (c == '\r') continue;
+    if (c == '\n') {
+      serialLine[serialLen] = '\0';
+      if (serialLen > 0) identityRunCommand(serialLine);
+      serialLen = 0;
+    } else if (serialLen < sizeof(serialLine) - 1) {
+      serialLine[serialLen++] = c;
+    }
+  }
+}
@@ -0,0 +1,106 @@
+#include "lane-switches.h"
+#include "config.h"
+#include "sample-ring.h"
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+
+struct LaneEdge {
+  uint8_t lane;
+  uint8_t level;
+  int64_t timeUs;
+};
+
+// Debounce state of one lane
+struct LaneState {
+  uint8_t stable;           // debounced level
+  bool pending;             // level differs from `stable`, waiting for it to hold
+  uint8_t candidate;
+  int64_t candidateSince;   // last edge; the level must hold from here
+  int64_t firstEdge;        // first edge of this transition (for latency)
+};
+
+// Every lane ISR runs on the core that attached it, one at a time, so
+// together they are the single producer of the ring
+static SampleRing<LaneEdge, LANE_EVENT_QUEUE> edges;
+static LaneState lanes[LANE_SWITCHES_MAX];
+static const uint8_t *lanePinList = nullptr;
+static int laneCount = 0;
+static LanePressCallback pressCallback = nullptr;
+static TaskHandle_t laneTask = NULL;
+
+static void IRAM_ATTR laneSwitchIsr(void *arg) {
+  int lane = (int)(intptr_t)arg;
+  LaneEdge edge = { (uint8_t)lane, (uint8_t)digitalRead(lanePinList[lane]), esp_timer_get_time() };
+  edges.push(edge);
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(laneTask, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+static void laneSwitchEdge(LaneState &state, uint8_t level, int64_t timeUs) {
+  if (level == state.stable) {
+    state.pending = false;  // bounced back
+    return;
+  }
+  if (!state.pending) state.firstEdge = timeUs;
+  state.pending = true;
+  state.candidate = level;
+  state.candidateSince = timeUs;
+}
+
+// Settle lanes whose new level has held long enough; returns the ticks
+// until the next one could settle
+static TickType_t laneSwitchesSettle(int64_t nowUs) {
+  const int64_t debounceUs = (int64_t)LANE_DEBOUNCE_MS * 1000;
+  TickType_t wait = pdMS_TO_TICKS(LANE_RESYNC_MS);
+  for (int lane = 0; lane < laneCount; lane++) {
+    LaneState &state = lanes[lane];
+    if (!state.pending) continue;
+    int64_t held = nowUs - state.candidateSince;
+    if (held < debounceUs) {
+      TickType_t ticks = pdMS_TO_TICKS((debounceUs - held + 999) / 1000) + 1;
+      if (ticks < wait) wait = ticks;
+      continue;
+    }
+    state.pending = false;
+    state.stable = state.candidate;
+    if (state.stable == LANE_PRESSED_LEVEL && pressCallback) pressCallback(lane, state.firstEdge);
+  }
+  return wait;
+}
+
+static void laneSwitchTask(void *param) {
+  TickType_t wait = pdMS_TO_TICKS(LANE_RESYNC_MS);
+  for (;;) {
+    bool notified = ulTaskNotifyTake(pdTRUE, wait) > 0;
+    LaneEdge edge;
+    while (edges.pop(edge)) laneSwitchEdge(lanes[edge.lane], edge.level, edge.timeUs);
+
+    int64_t now = esp_timer_get_time();
+    if (!notified) {
+      // quiet for a while: catch up on any edge the queue dropped
+      for (int lane = 0; lane < laneCount; lane++) {
+        if (!lanes[lane].pending) laneSwitchEdge(lanes[lane], digitalRead(lanePinList[lane]), now);
+      }
+    }
+    wait = laneSwitchesSettle(now);
+  }
+}
+
+void laneSwitchesInit(const uint8_t *pins, int count, LanePressCallback callback) {
+  if (laneTask != NULL) return;
+  lanePinList = pins;
+  laneCount = count > LANE_SWITCHES_MAX ? LANE_SWITCHES_MAX : count;
+  pressCallback = callback;
+  for (int lane = 0; lane < laneCount; lane++) {
+    // a switch already closed at boot is not a press
+    lanes[lane].stable = digitalRead(pins[lane]);
+    lanes[lane].pending = false;
+  }
+
+  xTaskCreatePinnedToCore(laneSwitchTask, "lanes", LANE_TASK_STACK, NULL,
+                          LANE_TASK_PRIORITY, &laneTask, LANE_TASK_CORE);
+  for (int lane = 0; lane < laneCount; lane++) {
+    attachInterruptArg(digitalPinToInterrupt(pins[lane]), laneSwitchIsr, (void *)(intptr_t)lane, CHANGE);
+  }
+}
@@ -0,0 +1,77 @@
+#include "latency.h"
+#include "freertos/FreeRTOS.h"
+#include <ArduinoJson.h>
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint64_t sumUs;
+  uint32_t maxUs;
+};
+
+// Written from the ESP-NOW ingest task, the lane switch task and the loop,
+// read by the web server
+static LatencyHistogram histograms[LATENCY_STAGE_COUNT];
+static portMUX_TYPE latencyMux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *STAGE_NAMES[LATENCY_STAGE_COUNT] = { "sampleToRx", "rxToWs", "sampleToWs", "laneToWs" };
+
+void latencyRecord(LatencyStage stage, int64_t us) {
+  if (us < 0) us = 0;
+  uint32_t value = us > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)us;
+  int bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+  if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+
+  portENTER_CRITICAL(&latencyMux);
+  LatencyHistogram &h = histograms[stage];
+  h.buckets[bucket]++;
+  h.count++;
+  h.sumUs += value;
+  if (value > h.maxUs) h.maxUs = value;
+  portEXIT_CRITICAL(&latencyMux);
+}
+
+void latencyReset() {
+  portENTER_CRITICAL(&latencyMux);
+  memset(histograms, 0, sizeof(histograms));
+  portEXIT_CRITICAL(&latencyMux);
+}
+
+// Upper bound of the bucket holding the given fraction of the samples
+static uint32_t latencyPercentile(const LatencyHistogram &h, float fraction) {
+  if (h.count == 0) return 0;
+  uint32_t target = (uint32_t)ceilf(h.count * fraction);
+  uint32_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += h.buckets[i];
+    if (seen >= target) return i == 0 ? 1 : (1u << i);
+  }
+  return h.maxUs;
+}
+
+String latencyAsJson() {
+  LatencyHistogram copy[LATENCY_STAGE_COUNT];
+  portENTER_CRITICAL(&latencyMux);
+  memcpy(copy, histograms, sizeof(copy));
+  portEXIT_CRITICAL(&latencyMux);
+
+  JsonDocument doc;
+  for (int s = 0; s < LATENCY_STAGE_COUNT; s++) {
+    const LatencyHistogram &h = copy[s];
+    JsonObject obj = doc[STAGE_NAMES[s]].to<JsonObject>();
+    obj["count"] = h.count;
+    obj["meanUs"] = h.count ? (uint32_t)(h.sumUs / h.count) : 0;
+    obj["maxUs"] = h.maxUs;
+    obj["p50Us"] = latencyPercentile(h, 0.50f);
+    obj["p95Us"] = latencyPercentile(h, 0.95f);
+    obj["p99Us"] = latencyPercentile(h, 0.99f);
+    // bucket i holds values below 2^i us; trailing empty buckets are left out
+    int last = LATENCY_BUCKETS - 1;
+    while (last > 0 && h.buckets[last] == 0) last--;
+    JsonArray buckets = obj["buckets"].to<JsonArray>();
+    for (int i = 0; i <= last; i++) buckets.add(h.buckets[i]);
+  }
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
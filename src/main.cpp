@@ -9,12 +9,20 @@
 #include "espnow.h"
 #include "battery.h"
 #include "pitbuttons.h"
+#include "stability.h"
+#include "identity.h"
+#include "nodes.h"
+#include "weighlog.h"
+#include "spec.h"
+#include "storage.h"
+#include "power.h"
 
 
 
 
 
 String mainMessage = "Starting up...";
+SpecVerdict settledVerdict = SPEC_VERDICT_NONE;  // child: verdict of the last settled reading
 // Button state tracking for tare button
 static int lastTareButtonState = HIGH; // set it high initially (not pressed)
 static int batteryReadCounter = 0;  // Counter for battery reading
@@ -25,11 +33,14 @@ void setup()
 {
   Serial.begin(115200);
 
+  // load role, node ID, name and calibration from NVS
+  identityInit();
+
   // initialise the LittleFS
   initLittleFS();
 
-  // get an initial vbat reading
-  vbat = readVBAT();
+  // first battery reading, then sampling moves to its own task
+  batteryInit();
 
   // initialise the OLED display
   displaysetup();
@@ -37,19 +48,18 @@ void setup()
   // configure tare button pin (use internal pullup so LOW means pressed)
   pinMode(TARE_BUTTON_PIN, INPUT_PULLUP);
 
-  // configure VBAT ADC pin
-  analogSetPinAttenuation(VBAT_PIN, ADC_0db);
-  analogReadResolution(12);
-
   // Only parent need to initialise:
   // - Wifi and mDNS
   // - websocket
   // - web server
-  if (ESPNOW_IS_PARENT) {
+  if (identityIsParent()) {
     initWifi();
     initMDNS();
+    storageInit();   // settings writes, off the network tasks
+    weighLogInit();  // weigh-in log on LittleFS
+    specInit();      // spec classes and node assignments
+    initpitbuttons();  // before the server, so page messages find the lane lock
     initwebservers();
-    initpitbuttons();
   } else {
     // We are a Child node so initialise the scale only
     initScale();
@@ -58,6 +68,9 @@ void setup()
   // initialise ESP-NOW (after WiFi so channel is correct for peers)
   espnowInit();
 
+  // child: idle policy for an empty launch block
+  powerInit();
+
   // load persisted settings
   settingsInit();
 
@@ -69,26 +82,38 @@ void loop()
   unsigned long currentTime = millis();
   
   
-  if (ESPNOW_IS_PARENT) {
-    // broadcast weight to connected web clients (parent only)
+  if (identityIsParent()) {
+    // drop closed web clients (weights are pushed as ESP-NOW data arrives)
     webBroadcastLoop();
 
-    // Update countdown timers every second
-    for (int i = 0; i < NUM_LANES; i++) {
-      if (buttonStates[i].countdown > 0 && (currentTime - countdownTimers[i]) >= 1000) {
-        buttonStates[i].countdown--;
-        countdownTimers[i] = currentTime;
-        notifyButtonClients();
-      }
-    }
-    // Check lane switches every 50 ms to debounce
-    if (currentTime - lastCheckTime > 50) {
-      lastCheckTime = currentTime;
-      checkLaneSwitches();
+    // lane countdowns need nothing here: pages tick them from the deadline
+    // Show the latest weigh-in and its verdict
+    ESPNowWeighIn weighIn;
+    while (espnowNextWeighIn(&weighIn)) {
+      char name[NODE_NAME_LEN + 1];
+      if (!nodesGetName(weighIn.node, name) || name[0] == '\0') snprintf(name, sizeof(name), "Node %u", weighIn.node);
+      String message = String(name) + "\n" + String(weighIn.weight, 1) + " g";
+      if (weighIn.verdict == SPEC_VERDICT_PASS) message += " PASS";
+      else if (weighIn.verdict == SPEC_VERDICT_FAIL) message += " FAIL";
+      displayText(message, vbat);
     }
 
   } else {
-    // Child node: read scale and send weight to parent every 500ms
+    // Child node: feed new samples to the stability detector every pass and
+    // report a settled reading the moment it locks, without waiting for the tick
+    // In batch mode every filtered sample is also queued for the parent
+    if (scaleUpdate(ESPNOW_BATCH_MODE ? espnowQueueBatchSample : nullptr)) {
+      // judge it against the class the parent pushed, if any
+      float settledWeight = stabilitySettledWeight();
+      SpecClass spec;
+      settledVerdict = specGetLocal(&spec) ? specCheck(spec, settledWeight) : SPEC_VERDICT_NONE;
+      espnowSendSettledWeight(settledWeight, settledVerdict, scaleSettledTime());
+      mainMessage = String(settledWeight, 1);
+      displayWeight(mainMessage, vbat, true, settledVerdict);
+    }
+
+    // Send the latest filtered reading from the HX711 task to the parent
+    // every 500ms (scaleRead() never blocks)
     if (currentTime - lastCheckTime > 500) { 
       lastCheckTime = currentTime;
 
@@ -96,21 +121,30 @@ void loop()
       uint8_t tareCmd = espnowGetPendingTareCommand();
       if (tareCmd != 0) {
         debugln("Performing pending tare command");
-        scaleTare();
-        // optional: send ack back (not implemented)
+        powerWake("tare from the parent");
+        scaleTare();  // already acknowledged when the command arrived
       }
 
       float reading = scaleRead();  // Read from scale
       if (!isnan(reading)) {
-        espnowSendWeight(reading);
+        // batch frames already carry every sample
+        if (!ESPNOW_BATCH_MODE) espnowSendWeight(reading, scaleReadTime());
 
+        powerUpdate(reading);  // idle after a long spell of nothing on the block
         mainMessage = String(reading, 1);
-        displayWeight(mainMessage, vbat); // print weight and battery to OLED
+        bool settled = stabilityIsSettled();
+        displayWeight(mainMessage, vbat, settled, settled ? settledVerdict : SPEC_VERDICT_NONE); // print weight and battery to OLED
       }
     }
   }
 
   // All nodes
+  // Periodic ESP-NOW housekeeping (pairing and hello announce on children)
+  espnowLoop();
+
+  // Serial provisioning commands (role, id, name, cal, ...)
+  identityHandleSerial();
+
   // Check tare button every loop
   tareButtonState = digitalRead(TARE_BUTTON_PIN);
   debug("Tare Button State: ");
@@ -120,19 +154,16 @@ void loop()
 
   if (tareButtonState == LOW && lastTareButtonState == HIGH) {
     debugln("Tare button is PRESSED - sending tare command");
-    if (!ESPNOW_IS_PARENT) {
+    if (!identityIsParent()) {
+      powerWake("tare button");
       scaleTare(); // send tare command
       debugln("Tare performed locally on Child node");
     } else {
-      // Parent node - broadcast tare command to all child nodes, max of 4
+      // Parent node - send a reliable tare to every known child node
       String tareMessage = "Taring all nodes...";
       displayText(tareMessage, vbat);
       Serial.println(tareMessage);
-           
-      for (uint8_t nodeId = 1; nodeId <= 4; nodeId++) {
-        debugln("Sending tare command to node " + String(nodeId));
-        espnowSendTare(nodeId);
-      }
+      espnowSendTareAll();
     }
   } else if (tareButtonState == LOW && lastTareButtonState == LOW) {
     debugln("Tare button is STILL PRESSED");
@@ -141,17 +172,18 @@ void loop()
   }
   lastTareButtonState = tareButtonState; // update button state
 
-  // Read battery voltage every 100 loops (~10 seconds)
+  // Refresh the battery readout every 100 loops (~10 seconds); the battery
+  // task keeps vbat current, so there is no ADC read here
   batteryReadCounter++;
   debug("Battery Read Counter: ");
   debugln(batteryReadCounter);
   if (batteryReadCounter >= 100) {
-    vbat = readVBAT();
     batteryReadCounter = 0;
     debugln("Battery Voltage: " + String(vbat, 2) + "v");
     mainMessage = "http:\\\\" + String(WiFi.getHostname()) + "\nIP: " + WiFi.localIP().toString();
     displayText(mainMessage, vbat); // update display with new voltage
   }
 
-  delay(100);
+  powerIdleSleep();         // child idle: timed light sleep where there is no automatic one
+  delay(powerLoopDelay());  // longer while idle, so the CPU can sleep
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "message-writer.h"
+
+MessageWriter::MessageWriter(std::vector<uint8_t> &buffer)
+  : overflow(false), out(buffer), needComma(false) {
+  out.clear();
+}
+
+void MessageWriter::put(char c) {
+  if (out.size() < out.capacity()) out.push_back((uint8_t)c); else overflow = true;
+}
+
+void MessageWriter::putBytes(const char *data, size_t len) {
+  if (out.capacity() - out.size() < len) {
+    overflow = true;
+    return;
+  }
+  out.insert(out.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+}
+
+// Comma before the next array element or object member
+void MessageWriter::separate() {
+  if (needComma) put(',');
+  needComma = false;
+}
+
+void MessageWriter::beginObject() { separate(); put('{'); }
+void MessageWriter::endObject() { put('}'); needComma = true; }
+void MessageWriter::beginArray() { separate(); put('['); }
+void MessageWriter::endArray() { put(']'); needComma = true; }
+
+void MessageWriter::key(const char *name) {
+  value(name);
+  put(':');
+  needComma = false;
+}
+
+void MessageWriter::value(const char *str) {
+  if (str == nullptr) {
+    null();
+    return;
+  }
+  separate();
+  put('"');
+  for (const char *p = str; *p; p++) {
+    char c = *p;
+    switch (c) {
+      case '"':  putBytes("\\\"", 2); break;
+      case '\\': putBytes("\\\\", 2); break;
+      case '\n': putBytes("\\n", 2); break;
+      case '\r': putBytes("\\r", 2); break;
+      case '\t': putBytes("\\t", 2); break;
+      default:
+        if ((uint8_t)c < 0x20) {
+          char esc[7];
+          snprintf(esc, sizeof(esc), "\\u%04x", (uint8_t)c);
+          putBytes(esc, 6);
+        } else {
+          put(c);
+        }
+    }
+  }
+  put('"');
+  needComma = true;
+}
+
+void MessageWriter::value(long long v) {
+  char num[22];
+  separate();
+  putBytes(num, snprintf(num, sizeof(num), "%lld", v));
+  needComma = true;
+}
+
+void MessageWriter::value(unsigned long long v) {
+  char num[22];
+  separate();
+  putBytes(num, snprintf(num, sizeof(num), "%llu", v));
+  needComma = true;
+}
+
+void MessageWriter::value(float v, int decimals) {
+  if (isnan(v) || isinf(v)) {
+    null();
+    return;
+  }
+  char num[24];
+  separate();
+  int n = snprintf(num, sizeof(num), "%.*f", decimals, v);
+  putBytes(num, n < (int)sizeof(num) ? n : sizeof(num) - 1);
+  needComma = true;
+}
+
+void MessageWriter::value(bool v) {
+  separate();
+  if (v) putBytes("true", 4); else putBytes("false", 5);
+  needComma = true;
+}
+
+void MessageWriter::null() {
+  separate();
+  putBytes("null", 4);
+  needComma = true;
+}
+
+void MessageWriter::raw(const char *json, size_t len) {
+  separate();
+  putBytes(json, len);
+  needComma = true;
+}
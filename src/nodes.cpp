@@ -0,0 +1,335 @@
+#include "nodes.h"
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "spec.h"
+#include "message-writer.h"
+#include "battery.h"
+
+// Slot lookup: a compact array of IDs (0 = free slot) scanned linearly,
+// with the node data in a parallel fixed array. No heap use after boot.
+static uint8_t slotIds[MAX_NODES];
+static NodeInfo nodes[MAX_NODES];
+
+// Bookkeeping that is not part of the public snapshot
+struct NodeLinkState {
+  bool haveSeq;
+  uint16_t lastSeq;
+  uint32_t windowStart;
+  uint16_t windowPackets;
+  // recent time-sync exchanges, best (lowest RTT) one is used
+  int64_t clockOffsets[NODE_CLOCK_WINDOW];
+  uint32_t clockRtts[NODE_CLOCK_WINDOW];
+  uint8_t clockCount;
+  uint8_t clockIndex;
+};
+static NodeLinkState linkState[MAX_NODES];
+
+static SemaphoreHandle_t nodesMutex = NULL;
+
+// Scratch copy for nodesWriteJson(); callers are the web server and the
+// WebSocket push task, so it is guarded by its own lock
+static NodeInfo jsonSnapshot[MAX_NODES];
+static SemaphoreHandle_t jsonMutex = NULL;
+
+void nodesInit() {
+  if (nodesMutex == NULL) nodesMutex = xSemaphoreCreateMutex();
+  if (jsonMutex == NULL) jsonMutex = xSemaphoreCreateMutex();
+  memset(slotIds, 0, sizeof(slotIds));
+}
+
+static void nodesLock() { xSemaphoreTake(nodesMutex, portMAX_DELAY); }
+static void nodesUnlock() { xSemaphoreGive(nodesMutex); }
+
+// Find the slot for an ID (-1 if not present). Caller holds the lock.
+static int nodesFindSlot(uint8_t id) {
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (slotIds[i] == id) return i;
+  }
+  return -1;
+}
+
+// Find the slot for a MAC (-1 if not present). Caller holds the lock.
+static int nodesFindSlotByMac(const uint8_t *mac) {
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (slotIds[i] != 0 && memcmp(nodes[i].mac, mac, 6) == 0) return i;
+  }
+  return -1;
+}
+
+bool nodesTouch(uint8_t id, const uint8_t *mac, uint16_t seq, bool hasSeq) {
+  if (id == 0) return false;
+  uint32_t now = millis();
+
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot < 0) {
+    slot = nodesFindSlot(0);  // first free slot
+    if (slot < 0) {
+      nodesUnlock();
+      return false;
+    }
+    slotIds[slot] = id;
+    NodeInfo &fresh = nodes[slot];
+    memset(&fresh, 0, sizeof(fresh));
+    fresh.id = id;
+    fresh.weight = NAN;
+    fresh.settledWeight = NAN;
+    memset(&linkState[slot], 0, sizeof(linkState[slot]));
+    linkState[slot].windowStart = now;
+  }
+
+  NodeInfo &node = nodes[slot];
+  NodeLinkState &link = linkState[slot];
+  memcpy(node.mac, mac, 6);
+  node.lastSeen = now;
+  node.packets++;
+
+  // sequence gaps = lost frames; a big jump means the node rebooted
+  if (hasSeq) {
+    if (link.haveSeq) {
+      uint16_t gap = (uint16_t)(seq - link.lastSeq - 1);
+      if (gap > 0 && gap < 1000) node.lossCount += gap;
+      if (gap >= 1000) {
+        // the node rebooted: its clock restarted, so resync from scratch
+        link.clockCount = 0;
+        link.clockIndex = 0;
+        node.clockSynced = false;
+      }
+    }
+    link.haveSeq = true;
+    link.lastSeq = seq;
+  }
+
+  link.windowPackets++;
+  uint32_t elapsed = now - link.windowStart;
+  if (elapsed >= NODE_RATE_WINDOW_MS) {
+    node.packetRate = link.windowPackets * 1000.0f / elapsed;
+    link.windowPackets = 0;
+    link.windowStart = now;
+  }
+  nodesUnlock();
+  return true;
+}
+
+void nodesSetWeight(uint8_t id, float weight, bool settled, uint8_t verdict) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) {
+    NodeInfo &node = nodes[slot];
+    node.weight = weight;
+    if (settled) {
+      node.settledWeight = weight;
+      node.verdict = verdict;
+    } else if (!isnan(node.settledWeight) &&
+               fabsf(weight - node.settledWeight) > STABILITY_RELEASE_DELTA) {
+      // forget a settled reading once the load has clearly changed
+      node.settledWeight = NAN;
+      node.verdict = SPEC_VERDICT_NONE;
+    }
+  }
+  nodesUnlock();
+}
+
+void nodesUpdateClock(uint8_t id, int64_t offsetUs, uint32_t rttUs) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) {
+    NodeLinkState &link = linkState[slot];
+    link.clockOffsets[link.clockIndex] = offsetUs;
+    link.clockRtts[link.clockIndex] = rttUs;
+    link.clockIndex = (link.clockIndex + 1) % NODE_CLOCK_WINDOW;
+    if (link.clockCount < NODE_CLOCK_WINDOW) link.clockCount++;
+
+    // the shortest round trip has the least queueing error in it
+    int best = 0;
+    for (int i = 1; i < link.clockCount; i++) {
+      if (link.clockRtts[i] < link.clockRtts[best]) best = i;
+    }
+    NodeInfo &node = nodes[slot];
+    node.clockOffset = link.clockOffsets[best];
+    node.clockRtt = link.clockRtts[best];
+    node.clockSynced = true;
+  }
+  nodesUnlock();
+}
+
+bool nodesChildToParentTime(uint8_t id, int64_t childUs, int64_t *parentUs) {
+  bool ok = false;
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0 && nodes[slot].clockSynced) {
+    *parentUs = childUs - nodes[slot].clockOffset;
+    ok = true;
+  }
+  nodesUnlock();
+  return ok;
+}
+
+void nodesSetTiming(uint8_t id, int64_t rxUs, int64_t sampleUs) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) {
+    nodes[slot].lastRxTime = rxUs;
+    nodes[slot].lastSampleTime = sampleUs;
+  }
+  nodesUnlock();
+}
+
+void nodesSetName(uint8_t id, const char *name) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) {
+    strncpy(nodes[slot].name, name, NODE_NAME_LEN);
+    nodes[slot].name[NODE_NAME_LEN] = '\0';
+  }
+  nodesUnlock();
+}
+
+void nodesSetBattery(uint8_t id, uint16_t millivolts, int8_t soc, uint16_t minutesLeft) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) {
+    nodes[slot].batteryMv = millivolts;
+    nodes[slot].batterySoc = soc;
+    nodes[slot].batteryMinutes = minutesLeft;
+  }
+  nodesUnlock();
+}
+
+void nodesRecordSendFailure(const uint8_t *mac) {
+  nodesLock();
+  int slot = nodesFindSlotByMac(mac);
+  if (slot >= 0) nodes[slot].sendFailures++;
+  nodesUnlock();
+}
+
+void nodesRecordRssi(const uint8_t *mac, int8_t rssi) {
+  nodesLock();
+  int slot = nodesFindSlotByMac(mac);
+  if (slot >= 0) nodes[slot].rssi = rssi;
+  nodesUnlock();
+}
+
+bool nodesGetMac(uint8_t id, uint8_t *mac) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) memcpy(mac, nodes[slot].mac, 6);
+  nodesUnlock();
+  return slot >= 0;
+}
+
+bool nodesGetName(uint8_t id, char *name) {
+  nodesLock();
+  int slot = nodesFindSlot(id);
+  if (slot >= 0) memcpy(name, nodes[slot].name, NODE_NAME_LEN + 1);
+  nodesUnlock();
+  return slot >= 0;
+}
+
+int nodesListIds(uint8_t *ids, int maxIds) {
+  int count = 0;
+  nodesLock();
+  for (int i = 0; i < MAX_NODES && count < maxIds; i++) {
+    if (slotIds[i] != 0) ids[count++] = slotIds[i];
+  }
+  nodesUnlock();
+  return count;
+}
+
+int nodesSnapshot(NodeInfo *out, int maxNodes) {
+  int count = 0;
+  uint32_t now = millis();
+  nodesLock();
+  for (int i = 0; i < MAX_NODES && count < maxNodes; i++) {
+    if (slotIds[i] == 0) continue;
+    out[count] = nodes[i];
+    // the rate is only worked out when a frame arrives; once a window has
+    // passed without one, report what the open window has seen so far so
+    // a node that went quiet drops to 0
+    uint32_t elapsed = now - linkState[i].windowStart;
+    if (elapsed >= NODE_RATE_WINDOW_MS) {
+      out[count].packetRate = linkState[i].windowPackets * 1000.0f / elapsed;
+    }
+    count++;
+  }
+  nodesUnlock();
+  return count;
+}
+
+bool nodesIsOnline(const NodeInfo &node, uint32_t now) {
+  return now - node.lastSeen < NODE_TIMEOUT_MS;
+}
+
+void nodesExpire() {
+  uint32_t now = millis();
+  nodesLock();
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (slotIds[i] != 0 && now - nodes[i].lastSeen >= NODE_EXPIRE_MS) {
+      Serial.print("Forgetting silent node ");
+      Serial.println(slotIds[i]);
+      slotIds[i] = 0;
+    }
+  }
+  nodesUnlock();
+}
+
+void nodesWriteJson(MessageWriter &w) {
+  xSemaphoreTake(jsonMutex, portMAX_DELAY);
+  int count = nodesSnapshot(jsonSnapshot, MAX_NODES);
+  uint32_t now = millis();
+
+  w.beginArray();
+  for (int i = 0; i < count; i++) {
+    const NodeInfo &node = jsonSnapshot[i];
+    char mac[18];
+    snprintf(mac, sizeof(mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+             node.mac[0], node.mac[1], node.mac[2], node.mac[3], node.mac[4], node.mac[5]);
+    w.beginObject();
+    w.field("id", node.id);
+    w.field("mac", mac);
+    w.field("name", node.name);
+    w.field("online", nodesIsOnline(node, now));
+    w.field("age", now - node.lastSeen);
+    w.field("weight", node.weight, 2);
+    if (!isnan(node.settledWeight)) w.field("settled", node.settledWeight, 2);
+    if (!isnan(node.settledWeight) && node.verdict != SPEC_VERDICT_NONE) w.field("pass", node.verdict == SPEC_VERDICT_PASS);
+    w.field("rate", node.packetRate, 1);
+    w.field("packets", node.packets);
+    w.field("loss", node.lossCount);
+    w.field("sendFail", node.sendFailures);
+    w.key("rssi");
+    if (node.rssi != 0) w.value(node.rssi); else w.null();
+    w.field("synced", node.clockSynced);
+    if (node.clockSynced) {
+      w.field("clockOffsetUs", node.clockOffset);
+      w.field("clockRttUs", node.clockRtt);
+    }
+    w.key("battery");
+    if (node.batteryMv != 0) {
+      w.beginObject();
+      w.field("v", node.batteryMv / 1000.0f, 2);
+      w.key("soc");
+      if (node.batterySoc != BATTERY_SOC_EXTERNAL) w.value(node.batterySoc); else w.null();
+      w.field("external", node.batterySoc == BATTERY_SOC_EXTERNAL);
+      w.key("minutesLeft");
+      if (node.batteryMinutes != BATTERY_MINUTES_UNKNOWN) w.value(node.batteryMinutes); else w.null();
+      w.field("low", node.batterySoc != BATTERY_SOC_EXTERNAL && node.batterySoc <= BATTERY_LOW_SOC);
+      w.endObject();
+    } else {
+      w.null();
+    }
+    w.endObject();
+  }
+  w.endArray();
+  xSemaphoreGive(jsonMutex);
+}
+
+String nodesAsJson() {
+  std::vector<uint8_t> out;
+  out.reserve(NODES_JSON_MAX);
+  MessageWriter w(out);
+  nodesWriteJson(w);
+  if (w.overflow) return "[]";
+  return String((const char *)out.data(), out.size());
+}
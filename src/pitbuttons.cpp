@@ -3,85 +3,245 @@
 #include "config.h"
 #include "display-oled.h"
 #include "webpage.h"
+#include "ws-topics.h"
+#include "storage.h"
+#include "lane-switches.h"
+#include "latency.h"
+#include "message-writer.h"
+#include <esp_timer.h>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 const uint8_t lanePins[NUM_LANES] = {16, 17, 18, 19};
 unsigned long lastCheckTime = 0;
-unsigned long countdownTimers[NUM_LANES] = {0};
 int countdownTimer;
 Preferences countdownPreference;
 
 ButtonState buttonStates[NUM_LANES] = {
-  {"Lane 1", 0},
-  {"Lane 2", 0},
-  {"Lane 3", 0},
-  {"Lane 4", 0}
+  {"Lane 1", false, 0},
+  {"Lane 2", false, 0},
+  {"Lane 3", false, 0},
+  {"Lane 4", false, 0}
 };
+// buttonStates is changed by page messages (async_tcp task) and switch
+// presses (lane task); both take this lock
+static SemaphoreHandle_t laneMutex = NULL;
 
 String customAnnounceMessageBefore = "";
 String customAnnounceMessageAfter = "";
 Preferences teamNamepreferences;
 
+// RAM copy of the team roster (JSON array) and its version. NVS is only
+// touched at boot and by the storage task; pages keep their own copy and
+// only fetch the list when their version differs.
+static String teamNamesJson = "[]";
+static uint32_t teamNamesVersion = 0;
 
+// The roster is one NVS blob: u8 format, u32 version, u16 count, then each
+// name as u8 length + bytes (names are cut at 255 bytes). Older firmware
+// kept one "teamN" string per team; those are read once and removed.
+#define ROSTER_KEY "roster"
+#define ROSTER_FORMAT 1
+#define ROSTER_HEADER_LEN 7
+
+
+
+// Messages are built with MessageWriter in a pooled buffer (ws-topics.h)
+// and that one buffer goes to the client that asked, or to every
+// subscriber of the topic
+static void pitSend(AsyncWebSocketClient *client, uint8_t topic, const MessageWriter &w,
+                    const AsyncWebSocketSharedBuffer &buffer) {
+  if (w.overflow) {
+    Serial.println("Pit message too long, not sent");
+    return;
+  }
+  if (client) client->text(buffer); else wsTopicsText(topic, buffer);
+}
+
+// Clock offset exchange: echo the page's timestamp with the parent's millis()
+// so the page can work out the offset from the round trip
+static void pitClockSync(AsyncWebSocketClient *client, JsonVariantConst pageTime) {
+  if (client == nullptr) return;
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(64);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "clockSync");
+  w.field("t", pageTime.as<long long>());
+  w.field("now", millis());
+  w.endObject();
+  pitSend(client, WS_TOPIC_LANES, w, buffer);
+}
+
+static bool rosterEncode(uint32_t version, JsonArrayConst names, std::vector<uint8_t> &out) {
+  out.clear();
+  out.push_back(ROSTER_FORMAT);
+  for (int i = 0; i < 4; i++) out.push_back((version >> (8 * i)) & 0xFF);
+  out.push_back(names.size() & 0xFF);
+  out.push_back((names.size() >> 8) & 0xFF);
+  for (JsonVariantConst name : names) {
+    const char *str = name | "";
+    size_t len = strnlen(str, 255);
+    out.push_back(len);
+    out.insert(out.end(), (const uint8_t *)str, (const uint8_t *)str + len);
+  }
+  return out.size() <= TEAM_ROSTER_MAX_BYTES;
+}
+
+static bool rosterDecode(const uint8_t *data, size_t len, uint32_t *version, JsonArray names) {
+  if (len < ROSTER_HEADER_LEN || data[0] != ROSTER_FORMAT) return false;
+  *version = data[1] | (data[2] << 8) | (data[3] << 16) | ((uint32_t)data[4] << 24);
+  uint16_t count = data[5] | (data[6] << 8);
+  size_t pos = ROSTER_HEADER_LEN;
+  for (uint16_t i = 0; i < count; i++) {
+    if (pos >= len || pos + 1 + data[pos] > len) return false;
+    names.add(String((const char *)data + pos + 1, data[pos]));
+    pos += 1 + data[pos];
+  }
+  return true;
+}
+
+// Storage content for the roster: the version travels with the names so a
+// write can never pair a new version with an old list
+static String rosterContent() {
+  return "{\"version\":" + String(teamNamesVersion) + ",\"teamNames\":" + teamNamesJson + "}";
+}
+
+// Read the roster blob, or the per-team keys of older firmware (migrated
+// to a blob through the storage task)
+static void loadTeamRoster() {
+  JsonDocument doc;
+  JsonArray names = doc.to<JsonArray>();
+  bool loaded = false;
+  bool legacy = false;
+  teamNamepreferences.begin("teamNames", true); // Open preferences with namespace "teamNames" in readOnly mode
+  size_t len = teamNamepreferences.getBytesLength(ROSTER_KEY);
+  if (len > 0 && len <= TEAM_ROSTER_MAX_BYTES) {
+    std::vector<uint8_t> blob(len);
+    loaded = teamNamepreferences.getBytes(ROSTER_KEY, blob.data(), len) == len &&
+             rosterDecode(blob.data(), len, &teamNamesVersion, names);
+    if (!loaded) {
+      Serial.println("Team roster unreadable, starting empty");
+      names.clear();
+    }
+  }
+  if (!loaded) {
+    for (int i = 0; ; i++) {
+      String teamId = "team" + String(i + 1); // Assuming team IDs are in the format "team1", "team2", etc.
+      String teamName = teamNamepreferences.getString(teamId.c_str(), "");
+      if (teamName == "") break;
+      names.add(teamName);
+      legacy = true;
+    }
+    // a page may hold a list cached from before the roster was lost or
+    // reflashed, so a fresh count must not start where that one did
+    teamNamesVersion = esp_random() & 0x7FFFFFFF;
+  }
+  teamNamepreferences.end(); // Close preferences
+  teamNamesJson = "";
+  serializeJson(doc, teamNamesJson);
+  if (legacy) {
+    debugln("Migrating " + String(names.size()) + " team names to the roster blob");
+    storageRequest(STORAGE_TEAM_NAMES, rosterContent());
+  }
+}
+
+// Load the team names and countdown saved in NVS
+static void loadPitPreferences() {
+  loadTeamRoster();
+
+  countdownPreference.begin("timer", true);
+  countdownTimer = countdownPreference.getInt("timer", 0);
+  countdownPreference.end();
+}
 
 void initpitbuttons(){ 
+  if (laneMutex == NULL) laneMutex = xSemaphoreCreateMutex();
+
   // Initialize lane pins
 
   for (int i = 0; i < NUM_LANES; i++) {
-    buttonStates[i].countdown = 0;
+    buttonStates[i].counting = false;
     pinMode(lanePins[i], INPUT_PULLUP); // Assuming switch closes to ground
   }
+  loadPitPreferences();
+  laneSwitchesInit(lanePins, NUM_LANES, onLanePressed);
+}
+
+// Seconds left on a countdown (caller holds laneMutex or a copy)
+static int pitSecondsLeft(const ButtonState &state) {
+  if (!state.counting) return 0;
+  long left = (long)(state.deadline - millis());
+  return left > 0 ? (left + 999) / 1000 : 0;
+}
+
+// Start a lane's countdown (1-based lane). With `onlyIfIdle` a countdown
+// already running is left alone and false is returned.
+static bool pitStartCountdown(int lane, bool onlyIfIdle) {
+  xSemaphoreTake(laneMutex, portMAX_DELAY);
+  ButtonState &state = buttonStates[lane-1];
+  bool start = !onlyIfIdle || pitSecondsLeft(state) == 0;
+  if (start) {
+    state.deadline = millis() + (unsigned long)countdownTimer * 1000;
+    state.counting = countdownTimer > 0;
+  }
+  xSemaphoreGive(laneMutex);
+  return start;
 }
 
-// This function takes a lane number and formats a message
-// It then sends the message to all connected clients
-void announcePilotSwap(int lane) {
-  String message = "{\"type\":\"pilotSwap\",\"team\":" + String(lane) + "}";
-  debug("announcePilotSwap message is:  ");
-  debugln(message);
-  buttonStates[lane-1].countdown = countdownTimer;
+// Tell the pit pages (before the slower OLED update); `edgeUs` is the
+// switch edge time for a lane switch press
+static void pitSendPilotSwap(int lane, int64_t edgeUs) {
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(48);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "pilotSwap");
+  w.field("team", lane);
+  w.endObject();
+  pitSend(nullptr, WS_TOPIC_LANES, w, buffer);
+  if (edgeUs != 0) latencyRecord(LATENCY_LANE_TO_WS, esp_timer_get_time() - edgeUs);
   String oledMessage = "Lane " + String(lane) + ": Pilot Swap";
   displayText(oledMessage);
-  ws.textAll(message);
 }
 
+// This function takes a lane number, starts its countdown and announces it
+void announcePilotSwap(int lane, int64_t edgeUs) {
+  debug("announcePilotSwap lane: ");
+  debugln(lane);
+  if (lane < 1 || lane > NUM_LANES) return;
+  pitStartCountdown(lane, false);
+  pitSendPilotSwap(lane, edgeUs);
+}
 
 
-void handleWebSocketMessage(void *arg, uint8_t *data, size_t len) {
-  debugln("Handling Websocket message");
-  AwsFrameInfo *info = (AwsFrameInfo*)arg;
-  if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT) {
-    data[len] = 0;
-    String message = (char*)data;
-    debugln("Message is: " + message);
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, message);
-    if (error) {
-      Serial.print(F("deserializeJson() failed: "));
-      Serial.println(error.f_str());
-      return;
-    }
-    String type = doc["type"];
-    if (type == "pilotSwap") {
-      pilotSwap(doc["teamId"], doc["buttonId"]);
-    } else if (type == "update") {
-      update(doc["teamId"], doc["teamName"]);
-    } else if (type == "updateCustomMessages") {
-      updateCustomMessages(doc["customMessageBefore"], doc["customMessageAfter"]);
-    } else if (type == "getCustomMessages") {
-      getCustomMessages();
-    } else if (type == "updateTeamNames") {
-      saveTeamNamesInPreferences(message);
-    } else if (type == "getTeamNames") {
-      getTeamNamesFromPreferences();
-    } else if (type == "getCountdownTimer") {
-      getCountdownTimer();
-    } else if (type == "updateCountdownTimer") {
-      updateCountdownTimer(doc["timerValue"]);
-    } else {
-      debugln("Unknown message type: " + type);
+
+// JSON messages from the pit-caller page (already parsed by onEvent)
+void handleWebSocketMessage(AsyncWebSocketClient *client, JsonDocument &doc) {
+  String type = doc["type"];
+  debugln("Handling Websocket message: " + type);
+  if (type == "pilotSwap") {
+    pilotSwap(doc["teamId"], doc["buttonId"]);
+  } else if (type == "update") {
+    update(doc["teamId"], doc["teamName"]);
+  } else if (type == "updateCustomMessages") {
+    updateCustomMessages(doc["customMessageBefore"], doc["customMessageAfter"]);
+  } else if (type == "getCustomMessages") {
+    getCustomMessages(client);
+  } else if (type == "updateTeamNames") {
+    if (!saveTeamNamesInPreferences(doc["teamNames"].as<JsonArrayConst>(), client ? client->id() : 0) && client) {
+      client->text("{\"type\":\"saved\",\"item\":\"teamNames\",\"ok\":false}");
     }
+  } else if (type == "getTeamNames") {
+    // no version (nothing cached) never matches: versions are 31-bit
+    getTeamNames(client, doc["version"].is<uint32_t>() ? doc["version"].as<uint32_t>() : UINT32_MAX);
+  } else if (type == "getCountdownTimer") {
+    getCountdownTimer(client);
+  } else if (type == "clockSync") {
+    pitClockSync(client, doc["t"]);
+  } else if (type == "updateCountdownTimer") {
+    updateCountdownTimer(doc["timerValue"], client ? client->id() : 0);
   } else {
-    debugln("Unknown message type");
+    debugln("Unknown message type: " + type);
   }
 }
 
@@ -98,7 +258,10 @@ void pilotSwap(String teamId, String buttonId) {
 void update(String teamId, String teamName) {
   debugln("Received update message for team: " + teamId + " with name: " + teamName);
   int lane = teamId.substring(4).toInt() - 1; // Assuming teamId is in the format "teamX"
+  if (lane < 0 || lane >= NUM_LANES) return;
+  xSemaphoreTake(laneMutex, portMAX_DELAY);
   buttonStates[lane].teamName = teamName;
+  xSemaphoreGive(laneMutex);
   notifyButtonClients(); // Ensure clients are notified after update
 }
 
@@ -106,102 +269,153 @@ void updateCustomMessages(String customMessageBefore, String customMessageAfter)
   // Receive and update custom messages
   customAnnounceMessageBefore = customMessageBefore;
   customAnnounceMessageAfter = customMessageAfter;
-  String broadcastMessage = "{\"type\":\"updateCustomMessages\",\"customMessageBefore\":\"" + customAnnounceMessageBefore + "\",\"customMessageAfter\":\"" + customAnnounceMessageAfter + "\"}";
-  ws.textAll(broadcastMessage);
+  getCustomMessages(nullptr);  // tell every pit page
 }
 
-void getCustomMessages() {
-  // Send the custom messages to the client
-  String broadcastMessage = "{\"type\":\"updateCustomMessages\",\"customMessageBefore\":\"" + customAnnounceMessageBefore + "\",\"customMessageAfter\":\"" + customAnnounceMessageAfter + "\"}";
-  ws.textAll(broadcastMessage);
+void getCustomMessages(AsyncWebSocketClient *client) {
+  // Send the custom messages to the client; room for every character to
+  // need a \u escape
+  size_t room = 96 + 6 * (customAnnounceMessageBefore.length() + customAnnounceMessageAfter.length());
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(room);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "updateCustomMessages");
+  w.field("customMessageBefore", customAnnounceMessageBefore);
+  w.field("customMessageAfter", customAnnounceMessageAfter);
+  w.endObject();
+  pitSend(client, WS_TOPIC_LANES, w, buffer);
 }
 
-// write the team names to the preferences API
-void saveTeamNamesInPreferences(String message) {
-  teamNamepreferences.begin("teamNames", false); // Open preferences with namespace "teamNames"
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, message);
-  if (error) {
-    Serial.print(F("deserializeJson() failed: "));
-    Serial.println(error.f_str());
-    return;
+// Keep the new team names in RAM under a new version, queue them for NVS
+// and tell the team subscribers which version is current
+bool saveTeamNamesInPreferences(JsonArrayConst teamNames, uint32_t clientId) {
+  debugln("Number of teams to save: " + String(teamNames.size()));
+  std::vector<uint8_t> blob;
+  if (!rosterEncode(0, teamNames, blob)) {
+    Serial.println("Team roster too large, not saved");
+    return false;
   }
-  JsonArray teamNames = doc["teamNames"].as<JsonArray>();
-  int numSavedTeams = teamNames.size();
-  debugln("Number of teams to save: " + String(numSavedTeams));
-  teamNamepreferences.clear(); // Clear all existing preferences
-  for (int i = 0; i < numSavedTeams; i++) {
-    String teamId = "team" + String(i + 1); // Assuming team IDs are in the format "team1", "team2", etc.
-    String teamName = teamNames[i].as<String>();
-    teamNamepreferences.putString(teamId.c_str(), teamName);
-    debugln("Saved team name: " + teamName + " for team ID: " + teamId);
+  teamNamesJson = "";
+  serializeJson(teamNames, teamNamesJson);
+  teamNamesVersion = (teamNamesVersion + 1) & 0x7FFFFFFF;
+  storageRequest(STORAGE_TEAM_NAMES, rosterContent(), clientId);
+
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(48);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "teamNamesVersion");
+  w.field("version", teamNamesVersion);
+  w.endObject();
+  pitSend(nullptr, WS_TOPIC_TEAMS, w, buffer);
+  return true;
+}
+
+// Storage task: write the roster blob, then drop the per-team keys of
+// older firmware (after the blob is safe, so a power cut loses nothing)
+bool pitWriteTeamNames(const String &content) {
+  JsonDocument doc;
+  if (deserializeJson(doc, content)) return false;
+  std::vector<uint8_t> blob;
+  if (!rosterEncode(doc["version"].as<uint32_t>(), doc["teamNames"].as<JsonArrayConst>(), blob)) return false;
+  if (!teamNamepreferences.begin("teamNames", false)) return false; // Open preferences with namespace "teamNames"
+  bool ok = teamNamepreferences.putBytes(ROSTER_KEY, blob.data(), blob.size()) == blob.size();
+  for (int i = 1; ok && teamNamepreferences.isKey(("team" + String(i)).c_str()); i++) {
+    teamNamepreferences.remove(("team" + String(i)).c_str());
   }
   teamNamepreferences.end(); // Close preferences
+  return ok;
 }
 
-void getTeamNamesFromPreferences() {
-  teamNamepreferences.begin("teamNames", true); // Open preferences with namespace "teamNames" in readOnly mode
-  String teamNames = "{\"type\":\"updateTeamNames\",\"teamNames\":[";
-  String teamName = "";
-  int i = 0;
-
-  while (true) {
-    String teamId = "team" + String(i + 1); // Assuming team IDs are in the format "team1", "team2", etc.
-    teamName = teamNamepreferences.getString(teamId.c_str(), "");
-    if (teamName == "") break;
-    // debugln("Read team name: " + teamName + " for team ID: " + teamId);
-    teamNames += "\"" + teamName + "\",";
-    i++;
+// The roster for a page that has `cachedVersion`: just the version if the
+// page is current, otherwise the whole list
+void getTeamNames(AsyncWebSocketClient *client, uint32_t cachedVersion) {
+  bool current = cachedVersion == teamNamesVersion;
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(current ? 48 : teamNamesJson.length() + 64);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", current ? "teamNamesCurrent" : "updateTeamNames");
+  w.field("version", teamNamesVersion);
+  if (!current) {
+    w.key("teamNames");
+    w.raw(teamNamesJson.c_str(), teamNamesJson.length());  // already JSON (serializeJson)
   }
-  // remove the last comma
-  teamNames = teamNames.substring(0, teamNames.length() - 1);
-  teamNames += "]}";
-  teamNamepreferences.end(); // Close preferences
-  debugln("Team names list from Preferences is: " + teamNames);
-  ws.textAll(teamNames);
+  w.endObject();
+  pitSend(client, WS_TOPIC_TEAMS, w, buffer);
 }
 
-void getCountdownTimer() {
-  countdownPreference.begin("timer", true);
-  countdownTimer = countdownPreference.getInt("timer", 0);
-  countdownPreference.end();
-  String timerString = "{\"type\":\"timerUpdate\",\"timerValue\":" + String(countdownTimer) + "}";
-  debugln("TimerValue is: " + countdownTimer);
-  ws.textAll(timerString);
+void getCountdownTimer(AsyncWebSocketClient *client) {
+  debug("TimerValue is: ");
+  debugln(countdownTimer);
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(48);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "timerUpdate");
+  w.field("timerValue", countdownTimer);
+  w.endObject();
+  pitSend(client, WS_TOPIC_LANES, w, buffer);
 }
 
-// Save the timer value to preferences
-void updateCountdownTimer(int timer) {
+// Use the new timer value now and queue it for NVS
+void updateCountdownTimer(int timer, uint32_t clientId) {
   countdownTimer = timer;
-  countdownPreference.begin("timer", false);
-  countdownPreference.putInt("timer", countdownTimer);
+  storageRequest(STORAGE_COUNTDOWN, String(countdownTimer), clientId);
+}
+
+// Storage task: save the timer value to preferences
+bool pitWriteCountdownTimer(const String &content) {
+  if (!countdownPreference.begin("timer", false)) return false;
+  bool ok = countdownPreference.putInt("timer", content.toInt()) > 0;
   countdownPreference.end();
+  return ok;
 }
 
-void checkLaneSwitches() {
-  for (int lane = 0; lane < NUM_LANES; lane++) {
-    if (digitalRead(lanePins[lane]) == HIGH) { // Assuming switch opens to HIGH but use LOW for testing
-      debugln("Lane " + String(lane+1) + " pressed");
-      if (buttonStates[lane].countdown == 0) { // Only trigger if not already in countdown
-        buttonStates[lane].countdown = countdownTimer;
-        countdownTimers[lane] = millis();
-        notifyButtonClients();
-        announcePilotSwap(lane+1); // add 1 because lane is 0 indexed
-      }
-    }
+// Lane switch press, from the lane switch task (debounced, see lane-switches.h)
+void onLanePressed(int lane, int64_t edgeUs) {
+  debugln("Lane " + String(lane+1) + " pressed");
+  // check and start under one lock, so a page press can't slip in between
+  if (pitStartCountdown(lane+1, true)) { // add 1 because lane is 0 indexed
+    pitSendPilotSwap(lane+1, edgeUs);
+    notifyButtonClients();
   }
 }
 
-void notifyButtonClients() {
-  String message = "{\"type\":\"update\",\"data\":[";
+int pitCountdownRemaining(int lane) {
+  xSemaphoreTake(laneMutex, portMAX_DELAY);
+  int remaining = pitSecondsLeft(buttonStates[lane]);
+  xSemaphoreGive(laneMutex);
+  return remaining;
+}
+
+// Sent when something changes, not every second: "now" is the parent's
+// millis() so a page can place each "deadline" on its own clock (see
+// clockSync); "countdown" is the seconds left when it was sent
+void notifyButtonClients(AsyncWebSocketClient *client) {
+  ButtonState lanes[NUM_LANES];
+  xSemaphoreTake(laneMutex, portMAX_DELAY);
+  for (int lane = 0; lane < NUM_LANES; lane++) lanes[lane] = buttonStates[lane];
+  xSemaphoreGive(laneMutex);
+
+  // team names are user text: room for each to be escaped in full
+  size_t room = 64;
+  for (int lane = 0; lane < NUM_LANES; lane++) room += 80 + 6 * lanes[lane].teamName.length();
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(room);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "update");
+  w.field("now", millis());
+  w.key("data");
+  w.beginArray();
   for (int lane = 0; lane < NUM_LANES; lane++) {
-    message += "{\"teamName\":\"" + buttonStates[lane].teamName + "\",\"countdown\":" + String(buttonStates[lane].countdown) + "}";
-    
-    if (lane < NUM_LANES - 1) message += ",";
+    int remaining = pitSecondsLeft(lanes[lane]);
+    w.beginObject();
+    w.field("teamName", lanes[lane].teamName);
+    w.field("countdown", remaining);
+    if (remaining > 0) w.field("deadline", lanes[lane].deadline);
+    w.endObject();
   }
-  message += "]}";
-  debugln("notifyButtonClients message is: " + message);
-  ws.textAll(message);
+  w.endArray();
+  w.endObject();
+  pitSend(client, WS_TOPIC_LANES, w, buffer);
 }
 
 void cleanupWebClients() {
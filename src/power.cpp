@@ -0,0 +1,143 @@
+#include "power.h"
+#include "config.h"
+#include "scale.h"
+#include <esp_wifi.h>
+#include <esp_now.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// Written by loop() (idle entry, parent commands) and the HX711 task (weight
+// seen while idle), so changes of mode go through one lock
+static SemaphoreHandle_t powerMutex = NULL;
+static volatile bool idle = false;
+static bool enabled = false;
+static unsigned long emptySince = 0;
+static bool autoLightSleep = false;     // the idle config has light sleep enabled
+static unsigned long awakeSince = 0;    // end of the last timed light sleep
+
+// Parent command retries: the longest gap between two sends and the time
+// from the first send to the last
+static constexpr uint32_t retryGap(int attempt) {
+  return ((uint32_t)ESPNOW_RETRY_BASE_MS << (attempt - 1)) > ESPNOW_RETRY_MAX_MS
+             ? ESPNOW_RETRY_MAX_MS : ((uint32_t)ESPNOW_RETRY_BASE_MS << (attempt - 1));
+}
+static constexpr uint32_t retrySpan(int attempts) {
+  return attempts <= 1 ? 0 : retrySpan(attempts - 1) + retryGap(attempts - 1);
+}
+// A listen window as long as the largest gap, opening before the retries
+// end, always holds one send
+static_assert(POWER_IDLE_LISTEN_MS >= retryGap(ESPNOW_MAX_ATTEMPTS - 1),
+              "POWER_IDLE_LISTEN_MS shorter than a command retry gap");
+static_assert(POWER_IDLE_SLEEP_MS + POWER_IDLE_LISTEN_MS <= retrySpan(ESPNOW_MAX_ATTEMPTS),
+              "idle light sleep can miss every retry of a parent command");
+
+// Radio and CPU settings for a mode
+static void powerApply(bool toIdle) {
+  awakeSince = millis();  // a full listen window before the first timed sleep
+  if (toIdle) {
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+    // connectionless power save: ESP-NOW listens for a window each interval
+    esp_wifi_connectionless_module_set_wake_interval(POWER_IDLE_WAKE_INTERVAL_MS);
+    esp_now_set_wake_window(POWER_IDLE_WAKE_WINDOW_MS);
+#endif
+    // only the connectionless settings above let an unassociated STA sleep;
+    // on core 2 this is a no-op and the radio stays on while idle
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+  } else {
+    esp_wifi_set_ps(WIFI_PS_NONE);
+  }
+
+  uint32_t mhz = toIdle ? POWER_IDLE_CPU_MHZ : POWER_ACTIVE_CPU_MHZ;
+#if CONFIG_PM_ENABLE
+  // light sleep whenever every task is blocked. Stock cores have power
+  // management but not tickless idle, which rejects the whole config, so
+  // try again with frequency scaling alone.
+  esp_pm_config_t pm = {};
+  pm.max_freq_mhz = POWER_ACTIVE_CPU_MHZ;
+  pm.min_freq_mhz = mhz;
+  pm.light_sleep_enable = toIdle;
+  autoLightSleep = false;
+  if (esp_pm_configure(&pm) == ESP_OK) {
+    autoLightSleep = toIdle;
+    return;
+  }
+  if (pm.light_sleep_enable) {
+    pm.light_sleep_enable = false;
+    if (esp_pm_configure(&pm) == ESP_OK) {
+      debugln("Light sleep not available, scaling CPU clock only");
+      return;
+    }
+  }
+  debugln("Power management not available, setting CPU clock");
+#endif
+  // no power management: a lower clock is what is left
+  setCpuFrequencyMhz(mhz);
+}
+
+void powerInit() {
+  if (identityIsParent() || POWER_IDLE_AFTER_MS == 0) return;
+  if (powerMutex == NULL) powerMutex = xSemaphoreCreateMutex();
+  emptySince = millis();
+  enabled = true;
+}
+
+void powerUpdate(float weight) {
+  if (!enabled || idle) return;
+  unsigned long now = millis();
+  if (isnan(weight) || fabsf(weight) >= POWER_IDLE_ZERO_G) {
+    emptySince = now;
+    return;
+  }
+  if (now - emptySince < POWER_IDLE_AFTER_MS) return;
+
+  xSemaphoreTake(powerMutex, portMAX_DELAY);
+  if (!idle) {
+    Serial.println("Scale empty, going idle");
+    idle = true;
+    scaleSetIdle(true);
+    powerApply(true);
+  }
+  xSemaphoreGive(powerMutex);
+}
+
+void powerWake(const char *reason) {
+  if (!enabled || !idle) return;
+  xSemaphoreTake(powerMutex, portMAX_DELAY);
+  if (idle) {
+    idle = false;
+    scaleSetIdle(false);
+    powerApply(false);
+    emptySince = millis();
+    Serial.print("Waking: ");
+    Serial.println(reason);
+  }
+  xSemaphoreGive(powerMutex);
+}
+
+bool powerIsIdle() {
+  return idle;
+}
+
+void powerIdleSleep() {
+  if (!idle || autoLightSleep) return;
+  unsigned long now = millis();
+  if (now - awakeSince < POWER_IDLE_LISTEN_MS) return;
+
+  // the whole chip stops, radio included; the tare button wakes it early
+  esp_sleep_enable_timer_wakeup((uint64_t)POWER_IDLE_SLEEP_MS * 1000);
+  gpio_wakeup_enable((gpio_num_t)CHILD_TARE_BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+  Serial.flush();
+  esp_light_sleep_start();
+  gpio_wakeup_disable((gpio_num_t)CHILD_TARE_BUTTON_PIN);  // back to a plain input
+  awakeSince = millis();
+}
+
+uint32_t powerLoopDelay() {
+  return idle ? POWER_IDLE_LOOP_MS : 100;
+}
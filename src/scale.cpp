@@ -5,14 +5,48 @@
 #include "freertos/semphr.h"
 #include "webpage.h"
 #include "display-oled.h"
+#include "sample-ring.h"
+#include "stability.h"
+#include "filters.h"
+#include "power.h"
 
 static SemaphoreHandle_t scaleMutex = NULL;
 HX711 scale;
 String scaleMessage = "";
 
+// Conversions handed from the acquisition task to the loop
+static SampleRing<ScaleSample, SCALE_RING_SIZE> sampleRing;
+static TaskHandle_t acquireTask = NULL;
+static float lastReading = NAN;
+static uint32_t lastReadingTime = 0;    // millis() the conversion behind lastReading was read
+static uint32_t settledTime = 0;        // millis() of the sample that locked the last settled reading
+static volatile bool scaleIdle = false;   // HX711 powered down between conversions (power.h)
+
+// Integer filter chains from config.h; the node's identity picks one
+static FilterChain<SCALE_FILTER_PROFILE_0> scaleFilter0;
+static FilterChain<SCALE_FILTER_PROFILE_1> scaleFilter1;
+static FilterChain<SCALE_FILTER_PROFILE_2> scaleFilter2;
+static uint8_t activeFilterProfile = 0;
+
+static int32_t scaleFilterProcess(int32_t raw) {
+    uint8_t profile = identityFilterProfile();
+    if (profile != activeFilterProfile) {
+        // start the new chain from scratch rather than from stale history
+        activeFilterProfile = profile;
+        scaleFilter0.reset();
+        scaleFilter1.reset();
+        scaleFilter2.reset();
+    }
+    switch (profile) {
+        case 1: return scaleFilter1.process(raw);
+        case 2: return scaleFilter2.process(raw);
+        default: return scaleFilter0.process(raw);
+    }
+}
+
 void initScale() {
     // Initialization code for the scale
-    // HX711 pins and calibration are defined in include/config.h
+    // HX711 pins are defined in include/config.h, calibration comes from NVS
 
     // create mutex if not already created
     if (scaleMutex == NULL) {
@@ -41,7 +75,7 @@ void initScale() {
     if (scaleMutex) xSemaphoreTake(scaleMutex, portMAX_DELAY);
     // mutex for performance in case called from multiple tasks
     
-    scale.set_scale(CALIBRATION_FACTOR);
+    scale.set_scale(identityCalibration());
     if (scale.wait_ready_timeout(500)) {
         scale.tare();  // Reset the scale to 0 on initialization
     } else {
@@ -49,6 +83,84 @@ void initScale() {
     }
     if (scaleMutex) xSemaphoreGive(scaleMutex);
     Serial.println("Scale initialized.");
+
+    scaleStartAcquisition();
+}
+
+// Idle: power the HX711 up for one conversion, then down again. A load
+// on the block wakes the node at once instead of waiting for loop().
+static void scaleIdleSample() {
+    ScaleSample sample;
+    bool haveSample = false;
+    xSemaphoreTake(scaleMutex, portMAX_DELAY);
+    if (scaleIdle) {
+        scale.power_up();
+        if (scale.wait_ready_timeout(POWER_HX711_SETTLE_MS, 5)) {
+            sample.timestamp = millis();
+            sample.raw = scale.read();
+            haveSample = true;
+        }
+        scale.power_down();
+    }
+    xSemaphoreGive(scaleMutex);
+    if (!haveSample) return;
+    sampleRing.push(sample);
+    if (fabsf(scaleToUnits(sample.raw)) >= POWER_IDLE_ZERO_G) powerWake("weight on the scale");
+}
+
+void scaleSetIdle(bool idle) {
+    if (scaleMutex) xSemaphoreTake(scaleMutex, portMAX_DELAY);
+    scaleIdle = idle;
+    if (idle) scale.power_down(); else scale.power_up();
+    if (scaleMutex) xSemaphoreGive(scaleMutex);
+    if (acquireTask != NULL) xTaskNotifyGive(acquireTask);  // cut the idle wait short
+}
+
+// Acquisition task: reads every HX711 conversion as soon as DOUT goes low
+// and pushes it into the sample ring. The chip sets the sample period
+// (10 or 80 Hz depending on the RATE pin), so no conversion is skipped.
+static void scaleAcquireTask(void *param) {
+    for (;;) {
+        if (scaleIdle) {
+            scaleIdleSample();
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POWER_IDLE_SAMPLE_MS));
+            continue;
+        }
+        if (scale.is_ready()) {
+            ScaleSample sample;
+            bool haveSample = false;
+            xSemaphoreTake(scaleMutex, portMAX_DELAY);
+            // re-check: a tare/calibrate may have consumed the conversion
+            if (scale.is_ready()) {
+                sample.timestamp = millis();
+                sample.raw = scale.read();
+                haveSample = true;
+            }
+            xSemaphoreGive(scaleMutex);
+            if (haveSample) sampleRing.push(sample);
+        }
+        // poll at the tick rate; a conversion takes 12.5 ms at 80 Hz
+        vTaskDelay(1);
+    }
+}
+
+void scaleStartAcquisition() {
+    if (acquireTask != NULL) return;
+    xTaskCreatePinnedToCore(scaleAcquireTask, "hx711", SCALE_TASK_STACK, NULL,
+                            SCALE_TASK_PRIORITY, &acquireTask, SCALE_TASK_CORE);
+    if (acquireTask == NULL) Serial.println("Failed to start HX711 acquisition task");
+}
+
+bool scalePopSample(ScaleSample &sample) {
+    return sampleRing.pop(sample);
+}
+
+float scaleToUnits(int32_t raw) {
+    return (float)(raw - scale.get_offset()) / scale.get_scale();
+}
+
+uint32_t scaleDroppedSamples() {
+    return sampleRing.dropped();
 }
 
 // Calibrate scale
@@ -108,19 +220,45 @@ void scaleTare() {
     if (scale.wait_ready_timeout(500)) scale.tare(); else Serial.println("HX711 not found.");
     Serial.println("Tare done...");
     if (scaleMutex) xSemaphoreGive(scaleMutex);
+    stabilityReset();
 }
 
 
+// Drain the sample ring: run every conversion through the filter chain
+// (integer counts) and feed the result to the stability detector.
+// Call every loop pass; never blocks.
+// Returns true if a new settled reading was locked in.
+bool scaleUpdate(void (*onSample)(uint32_t timestamp, float weight)) {
+    ScaleSample sample;
+    bool newlySettled = false;
+    while (sampleRing.pop(sample)) {
+        int32_t filtered = scaleFilterProcess(sample.raw);
+        lastReading = scaleToUnits(filtered);
+        lastReadingTime = sample.timestamp;
+        if (onSample) onSample(sample.timestamp, lastReading);
+        if (stabilityAddSample(sample.timestamp, lastReading)) {
+            newlySettled = true;
+            settledTime = sample.timestamp;
+        }
+    }
+    return newlySettled;
+}
+
 // Read from the single scale (child nodes only)
+// Returns the latest filtered reading as of the last scaleUpdate() pass.
+// Never blocks and never drains the ring itself: loop()'s scaleUpdate()
+// is its only consumer, so no sample misses the batch stream or the
+// stability detector. NaN until the first conversion has arrived.
 float scaleRead() {
-    float result = NAN;
-    if (scaleMutex) xSemaphoreTake(scaleMutex, portMAX_DELAY);
-    // Child nodes only have one scale, so ignore 'which' parameter
-    if (scale.wait_ready_timeout(200)) {
-        result = scale.get_units(5);
-    }
-    if (scaleMutex) xSemaphoreGive(scaleMutex);
-    return result;
+    return lastReading;
+}
+
+uint32_t scaleReadTime() {
+    return lastReadingTime;
+}
+
+uint32_t scaleSettledTime() {
+    return settledTime;
 }
 
 // Dummy units for testing without scale
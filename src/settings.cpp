@@ -1,5 +1,6 @@
 #include "settings.h"
 #include "littlefs-conf.h"
+#include "storage.h"
 #include <ArduinoJson.h>
 
 static String name1 = "Grey";
@@ -40,16 +41,11 @@ void settingsSetColor(int which, const String &c) {
 }
 
 bool settingsSave() {
-  JsonDocument doc;
-  doc["name1"] = name1;
-  doc["name2"] = name2;
-  doc["color1"] = color1;
-  doc["color2"] = color2;
-  File f = LittleFS.open(SETTINGS_PATH, "w");
-  if (!f) return false;
-  size_t n = serializeJson(doc, f);
-  f.close();
-  return n > 0;
+  return storageRequest(STORAGE_SETTINGS, settingsAsJson());
+}
+
+bool settingsWrite(const String &content) {
+  return storageWriteFile(SETTINGS_PATH, content);
 }
 
 String settingsAsJson() {
@@ -0,0 +1,160 @@
+#include "spec.h"
+#include "config.h"
+#include "littlefs-conf.h"
+#include "storage.h"
+#include <ArduinoJson.h>
+#include "freertos/FreeRTOS.h"
+
+static const char *SPEC_PATH = "/spec.json";
+
+// Parent: written by the web server, read by the ESP-NOW ingest task and loop()
+static SpecClass classes[SPEC_MAX_CLASSES];
+static int classCount = 0;
+static uint8_t nodeClasses[MAX_NODES + 1];   // by node ID; 0 = first class
+static uint32_t version = 1;
+
+// Child: class pushed by the parent (written in the radio callback)
+static SpecClass localSpec;
+static bool haveLocalSpec = false;
+
+static portMUX_TYPE specMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void specCopyName(char *out, const char *name) {
+  strncpy(out, name ? name : "", SPEC_NAME_LEN);
+  out[SPEC_NAME_LEN] = '\0';
+}
+
+void specInit() {
+  classCount = 1;
+  specCopyName(classes[0].name, "Default");
+  classes[0].minWeight = SPEC_DEFAULT_MIN_WEIGHT;
+  memset(nodeClasses, 0, sizeof(nodeClasses));
+
+  if (!LittleFS.exists(SPEC_PATH)) return;
+  File f = LittleFS.open(SPEC_PATH, "r");
+  if (!f) return;
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, f);
+  f.close();
+  if (err) {
+    Serial.println("spec.json unreadable, using the default class");
+    return;
+  }
+
+  SpecClass loaded[SPEC_MAX_CLASSES];
+  int count = 0;
+  for (JsonObject obj : doc["classes"].as<JsonArray>()) {
+    if (count >= SPEC_MAX_CLASSES || !obj["min"].is<float>()) continue;
+    specCopyName(loaded[count].name, obj["name"] | "");
+    loaded[count].minWeight = obj["min"];
+    count++;
+  }
+  if (count > 0) specSetClasses(loaded, count);
+  for (JsonPair kv : doc["nodes"].as<JsonObject>()) {
+    int id = atoi(kv.key().c_str());
+    specSetNodeClass(id, kv.value().as<uint8_t>());
+  }
+}
+
+int specClassCount() {
+  return classCount;
+}
+
+bool specGetClass(int index, SpecClass *out) {
+  bool ok = false;
+  portENTER_CRITICAL(&specMux);
+  if (index >= 0 && index < classCount) {
+    *out = classes[index];
+    ok = true;
+  }
+  portEXIT_CRITICAL(&specMux);
+  return ok;
+}
+
+bool specSetClasses(const SpecClass *newClasses, int count) {
+  if (count < 1 || count > SPEC_MAX_CLASSES) return false;
+  portENTER_CRITICAL(&specMux);
+  for (int i = 0; i < count; i++) classes[i] = newClasses[i];
+  classCount = count;
+  version++;
+  portEXIT_CRITICAL(&specMux);
+  return true;
+}
+
+uint8_t specNodeClass(uint8_t nodeId) {
+  if (nodeId > MAX_NODES) return 0;
+  return nodeClasses[nodeId];
+}
+
+void specSetNodeClass(uint8_t nodeId, uint8_t classIndex) {
+  if (nodeId == 0 || nodeId > MAX_NODES || classIndex >= SPEC_MAX_CLASSES) return;
+  portENTER_CRITICAL(&specMux);
+  nodeClasses[nodeId] = classIndex;
+  version++;
+  portEXIT_CRITICAL(&specMux);
+}
+
+bool specForNode(uint8_t nodeId, SpecClass *out) {
+  bool ok = false;
+  portENTER_CRITICAL(&specMux);
+  if (classCount > 0) {
+    uint8_t index = nodeId <= MAX_NODES ? nodeClasses[nodeId] : 0;
+    if (index >= classCount) index = 0;  // class was removed
+    *out = classes[index];
+    ok = true;
+  }
+  portEXIT_CRITICAL(&specMux);
+  return ok;
+}
+
+uint32_t specVersion() {
+  return version;
+}
+
+bool specSave() {
+  return storageRequest(STORAGE_SPEC, specAsJson());
+}
+
+bool specWrite(const String &content) {
+  return storageWriteFile(SPEC_PATH, content);
+}
+
+String specAsJson() {
+  JsonDocument doc;
+  JsonArray arr = doc["classes"].to<JsonArray>();
+  JsonObject nodes = doc["nodes"].to<JsonObject>();
+  for (int i = 0; i < classCount; i++) {
+    SpecClass spec;
+    if (!specGetClass(i, &spec)) break;
+    JsonObject obj = arr.add<JsonObject>();
+    obj["name"] = spec.name;
+    obj["min"] = spec.minWeight;
+  }
+  for (int id = 1; id <= MAX_NODES; id++) {
+    if (nodeClasses[id] != 0) nodes[String(id)] = nodeClasses[id];
+  }
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+void specSetLocal(const SpecClass &spec) {
+  portENTER_CRITICAL(&specMux);
+  localSpec = spec;
+  localSpec.name[SPEC_NAME_LEN] = '\0';
+  haveLocalSpec = true;
+  portEXIT_CRITICAL(&specMux);
+}
+
+bool specGetLocal(SpecClass *out) {
+  portENTER_CRITICAL(&specMux);
+  bool ok = haveLocalSpec;
+  if (ok) *out = localSpec;
+  portEXIT_CRITICAL(&specMux);
+  return ok;
+}
+
+SpecVerdict specCheck(const SpecClass &spec, float weight) {
+  if (isnan(weight) || isnan(spec.minWeight)) return SPEC_VERDICT_NONE;
+  return weight >= spec.minWeight ? SPEC_VERDICT_PASS : SPEC_VERDICT_FAIL;
+}
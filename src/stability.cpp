@@ -0,0 +1,69 @@
+#include "stability.h"
+#include "config.h"
+
+// Sliding window of the most recent samples
+static float window[STABILITY_WINDOW];
+static int windowCount = 0;
+static int windowIndex = 0;
+
+static uint32_t stableSince = 0;     // time the window first went quiet (0 = moving)
+static bool settled = false;         // a reading is currently locked
+static float settledWeight = NAN;
+
+void stabilityReset() {
+  windowCount = 0;
+  windowIndex = 0;
+  stableSince = 0;
+  settled = false;
+  settledWeight = NAN;
+}
+
+bool stabilityAddSample(uint32_t timestamp, float weight) {
+  if (isnan(weight)) return false;
+
+  window[windowIndex] = weight;
+  windowIndex = (windowIndex + 1) % STABILITY_WINDOW;
+  if (windowCount < STABILITY_WINDOW) windowCount++;
+  if (windowCount < STABILITY_WINDOW) return false;
+
+  // mean and variance over the window
+  float mean = 0.0f;
+  for (int i = 0; i < STABILITY_WINDOW; i++) mean += window[i];
+  mean /= STABILITY_WINDOW;
+  float variance = 0.0f;
+  for (int i = 0; i < STABILITY_WINDOW; i++) {
+    float d = window[i] - mean;
+    variance += d * d;
+  }
+  variance /= STABILITY_WINDOW;
+
+  // Release the lock once the load has clearly changed (drone lifted or swapped)
+  if (settled && fabsf(mean - settledWeight) > STABILITY_RELEASE_DELTA) {
+    settled = false;
+    stableSince = 0;
+  }
+
+  if (variance > STABILITY_MAX_VARIANCE) {
+    stableSince = 0;
+    return false;
+  }
+
+  if (stableSince == 0) stableSince = timestamp ? timestamp : 1;
+  if (settled || timestamp - stableSince < STABILITY_HOLD_MS) return false;
+
+  // An empty launch block is stable too, but is not a weigh-in
+  if (fabsf(mean) < STABILITY_MIN_WEIGHT) return false;
+
+  settled = true;
+  settledWeight = mean;
+  debugln("Settled at " + String(mean, 1) + " g");
+  return true;
+}
+
+bool stabilityIsSettled() {
+  return settled;
+}
+
+float stabilitySettledWeight() {
+  return settledWeight;
+}
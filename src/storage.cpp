@@ -0,0 +1,149 @@
+#include "storage.h"
+#include "config.h"
+#include "littlefs-conf.h"
+#include "settings.h"
+#include "spec.h"
+#include "pitbuttons.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Each module writes its own item; called on the storage task only
+static const struct {
+  const char *name;       // reported in acks
+  bool (*write)(const String &content);
+} STORAGE_ITEMS[STORAGE_ITEM_COUNT] = {
+  { "settings",  settingsWrite },
+  { "spec",      specWrite },
+  { "teamNames", pitWriteTeamNames },
+  { "countdown", pitWriteCountdownTimer },
+};
+
+// One slot per item: the newest contents waiting to be written and who to
+// tell. Written by the network tasks, drained by the storage task.
+struct StorageSlot {
+  bool pending;
+  String content;
+  unsigned long firstRequest;   // millis() of the oldest unwritten change
+  unsigned long lastRequest;    // millis() of the newest change
+  uint32_t waiters[STORAGE_MAX_WAITERS];
+  uint8_t waiterCount;
+};
+
+static StorageSlot slots[STORAGE_ITEM_COUNT];
+static SemaphoreHandle_t storageMutex = NULL;
+static TaskHandle_t storageTask = NULL;
+static StorageAckCallback ackCallback = nullptr;
+
+bool storageWriteFile(const char *path, const String &content) {
+  String tmpPath = String(path) + ".tmp";
+  File f = LittleFS.open(tmpPath, "w");
+  if (!f) return false;
+  size_t n = f.print(content);
+  f.close();
+  if (n != content.length()) {
+    LittleFS.remove(tmpPath.c_str());
+    return false;
+  }
+  // LittleFS renames over an existing file atomically
+  return LittleFS.rename(tmpPath.c_str(), path);
+}
+
+static bool storageIsDue(const StorageSlot &slot, unsigned long now) {
+  return slot.pending && (now - slot.lastRequest >= STORAGE_DEBOUNCE_MS ||
+                          now - slot.firstRequest >= STORAGE_MAX_DELAY_MS);
+}
+
+// Ticks until the next pending item is due, or portMAX_DELAY if none.
+// Caller holds storageMutex.
+static TickType_t storageNextDue(unsigned long now) {
+  TickType_t wait = portMAX_DELAY;
+  for (int i = 0; i < STORAGE_ITEM_COUNT; i++) {
+    const StorageSlot &slot = slots[i];
+    if (!slot.pending) continue;
+    unsigned long quietLeft = STORAGE_DEBOUNCE_MS - (now - slot.lastRequest);
+    unsigned long ageLeft = STORAGE_MAX_DELAY_MS - (now - slot.firstRequest);
+    TickType_t ticks = pdMS_TO_TICKS(quietLeft < ageLeft ? quietLeft : ageLeft) + 1;
+    if (ticks < wait) wait = ticks;
+  }
+  return wait;
+}
+
+static void storageWrite(int item) {
+  String content;
+  uint32_t waiters[STORAGE_MAX_WAITERS];
+  uint8_t waiterCount;
+
+  // take the contents out so new requests can queue while flash is busy
+  xSemaphoreTake(storageMutex, portMAX_DELAY);
+  StorageSlot &slot = slots[item];
+  content = std::move(slot.content);
+  slot.content = String();
+  waiterCount = slot.waiterCount;
+  memcpy(waiters, slot.waiters, sizeof(waiters));
+  slot.waiterCount = 0;
+  slot.pending = false;
+  xSemaphoreGive(storageMutex);
+
+  bool ok = STORAGE_ITEMS[item].write(content);
+  if (!ok) {
+    Serial.print("Storage: writing ");
+    Serial.print(STORAGE_ITEMS[item].name);
+    Serial.println(" failed");
+  }
+  if (ackCallback == nullptr) return;
+  for (int i = 0; i < waiterCount; i++) ackCallback(waiters[i], STORAGE_ITEMS[item].name, ok);
+}
+
+// Sleep until a request arrives or a pending item is due, then write
+// everything that is due
+static void storageTaskLoop(void *param) {
+  TickType_t wait = portMAX_DELAY;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, wait);
+    for (;;) {
+      int due = -1;
+      xSemaphoreTake(storageMutex, portMAX_DELAY);
+      unsigned long now = millis();
+      for (int i = 0; i < STORAGE_ITEM_COUNT && due < 0; i++) {
+        if (storageIsDue(slots[i], now)) due = i;
+      }
+      if (due < 0) wait = storageNextDue(now);
+      xSemaphoreGive(storageMutex);
+      if (due < 0) break;
+      storageWrite(due);
+    }
+  }
+}
+
+void storageInit() {
+  if (storageMutex == NULL) storageMutex = xSemaphoreCreateMutex();
+  if (storageTask == NULL) {
+    xTaskCreatePinnedToCore(storageTaskLoop, "storage", STORAGE_TASK_STACK, NULL,
+                            STORAGE_TASK_PRIORITY, &storageTask, STORAGE_TASK_CORE);
+  }
+}
+
+bool storageRequest(StorageItem item, const String &content, uint32_t clientId) {
+  if (storageTask == NULL || item >= STORAGE_ITEM_COUNT) return false;
+
+  xSemaphoreTake(storageMutex, portMAX_DELAY);
+  StorageSlot &slot = slots[item];
+  unsigned long now = millis();
+  if (!slot.pending) slot.firstRequest = now;
+  slot.pending = true;
+  slot.lastRequest = now;
+  slot.content = content;
+  if (clientId != 0) {
+    bool known = false;
+    for (int i = 0; i < slot.waiterCount; i++) known |= slot.waiters[i] == clientId;
+    if (!known && slot.waiterCount < STORAGE_MAX_WAITERS) slot.waiters[slot.waiterCount++] = clientId;
+  }
+  xSemaphoreGive(storageMutex);
+
+  xTaskNotifyGive(storageTask);
+  return true;
+}
+
+void storageSetAckCallback(StorageAckCallback callback) {
+  ackCallback = callback;
+}
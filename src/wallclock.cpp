@@ -0,0 +1,22 @@
+#include "wallclock.h"
+#include "config.h"
+#include <sys/time.h>
+#include <time.h>
+
+void wallClockStartSntp() {
+  configTime(0, 0, WALLCLOCK_NTP_SERVER);  // UTC; the CSV export says so
+}
+
+void wallClockFromPage(int64_t unixMs) {
+  if (wallClockNow() != 0 || unixMs / 1000 < WALLCLOCK_VALID_AFTER) return;
+  struct timeval tv;
+  tv.tv_sec = unixMs / 1000;
+  tv.tv_usec = (unixMs % 1000) * 1000;
+  settimeofday(&tv, nullptr);
+  Serial.println("Wall clock set from browser");
+}
+
+uint32_t wallClockNow() {
+  time_t now = time(nullptr);
+  return now >= WALLCLOCK_VALID_AFTER ? (uint32_t)now : 0;
+}
@@ -0,0 +1,138 @@
+#include "web-assets.h"
+#include "config.h"
+#include "littlefs-conf.h"
+#include "esp_rom_crc.h"
+
+struct WebAsset {
+  String path;       // URL path (the file may be stored as path + ".gz")
+  char etag[20];     // quoted
+  bool longCache;    // may be reused without revalidating
+};
+
+static WebAsset assets[WEB_ASSETS_MAX];
+static int assetCount = 0;
+
+// Pages, scripts and styles are linked by plain URLs with no version in
+// them, so they are always revalidated (a 304 while the ETag matches) and a
+// new build shows up on the next load. Only images are cached for a while.
+static const struct {
+  const char *ext;
+  const char *type;
+  bool longCache;
+} CONTENT_TYPES[] = {
+  { ".html", "text/html",       false },
+  { ".js",   "text/javascript", false },
+  { ".css",  "text/css",        false },
+  { ".png",  "image/png",       true },
+  { ".svg",  "image/svg+xml",   true },
+  { ".ico",  "image/x-icon",    true },
+  { ".txt",  "text/plain",      false },
+};
+
+static char longCacheControl[32];
+
+// nullptr for files that are not page assets (settings, weigh-in log, ...)
+static const char *webAssetContentType(const String &path, bool *longCache = nullptr) {
+  for (const auto &ct : CONTENT_TYPES) {
+    if (path.endsWith(ct.ext)) {
+      if (longCache) *longCache = ct.longCache;
+      return ct.type;
+    }
+  }
+  return nullptr;
+}
+
+// A gzip file ends with the CRC-32 and length of the original data, which
+// makes a strong validator without reading the rest of the file
+static bool webAssetGzipTag(File &f, char *etag, size_t cap) {
+  if (f.size() < 18 || !f.seek(f.size() - 8)) return false;
+  uint8_t tail[8];
+  if (f.read(tail, sizeof(tail)) != sizeof(tail)) return false;
+  uint32_t crc = tail[0] | (tail[1] << 8) | (tail[2] << 16) | ((uint32_t)tail[3] << 24);
+  uint32_t size = tail[4] | (tail[5] << 8) | (tail[6] << 16) | ((uint32_t)tail[7] << 24);
+  snprintf(etag, cap, "\"%08lx%lx\"", (unsigned long)crc, (unsigned long)size);
+  return true;
+}
+
+// Plain files (images, or a data/ uploaded without the build step) get a
+// CRC-32 of the content
+static bool webAssetFileTag(File &f, char *etag, size_t cap) {
+  uint8_t buf[256];
+  uint32_t crc = 0;
+  size_t n;
+  while ((n = f.read(buf, sizeof(buf))) > 0) crc = esp_rom_crc32_le(crc, buf, n);
+  snprintf(etag, cap, "\"%08lx%lx\"", (unsigned long)crc, (unsigned long)f.size());
+  return true;
+}
+
+static void webAssetsScan(const String &dir) {
+  File root = LittleFS.open(dir);
+  if (!root || !root.isDirectory()) return;
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    String path = f.path();
+    if (f.isDirectory()) {
+      f.close();
+      webAssetsScan(path);
+      continue;
+    }
+    bool gzip = path.endsWith(".gz");
+    if (gzip) path.remove(path.length() - 3);
+    bool longCache = false;
+    if (webAssetContentType(path, &longCache) == nullptr) {
+      f.close();
+      continue;
+    }
+    if (assetCount >= WEB_ASSETS_MAX) {
+      Serial.println("Too many web assets, not indexing " + path);
+      f.close();
+      continue;
+    }
+    WebAsset &asset = assets[assetCount];
+    bool ok = gzip ? webAssetGzipTag(f, asset.etag, sizeof(asset.etag))
+                   : webAssetFileTag(f, asset.etag, sizeof(asset.etag));
+    f.close();
+    if (!ok) continue;
+    asset.path = path;
+    asset.longCache = longCache;
+    assetCount++;
+  }
+  root.close();
+}
+
+void webAssetsInit() {
+  snprintf(longCacheControl, sizeof(longCacheControl), "public, max-age=%d", WEB_ASSET_MAX_AGE);
+  assetCount = 0;
+  webAssetsScan("/");
+  debug("Web assets indexed: ");
+  debugln(assetCount);
+}
+
+bool webAssetsSend(AsyncWebServerRequest *request, const String &url) {
+  String path = url.endsWith("/") ? url + "index.html" : url;
+  const WebAsset *asset = nullptr;
+  for (int i = 0; i < assetCount; i++) {
+    if (assets[i].path == path) {
+      asset = &assets[i];
+      break;
+    }
+  }
+  if (asset == nullptr) return false;
+
+  const char *cacheControl = asset->longCache ? longCacheControl : "no-cache";
+
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+    AsyncWebServerResponse *response = request->beginResponse(304, "text/plain", "");
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", cacheControl);
+    request->send(response);
+    return true;
+  }
+
+  // for a gzipped asset the library finds path + ".gz" and adds
+  // Content-Encoding: gzip itself
+  AsyncWebServerResponse *response = request->beginResponse(LittleFS, path, webAssetContentType(path));
+  response->addHeader("ETag", asset->etag);
+  response->addHeader("Cache-Control", cacheControl);
+  request->send(response);
+  return true;
+}
@@ -5,40 +5,146 @@
 #include "espnow.h"
 #include "config.h"
 #include "pitbuttons.h"
-#include <map>
+#include "nodes.h"
+#include "latency.h"
+#include "weight-frame.h"
+#include "ws-topics.h"
+#include "history.h"
+#include "weighlog.h"
+#include "spec.h"
+#include "web-assets.h"
+#include "storage.h"
+#include "message-writer.h"
+#include "wallclock.h"
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 #include <ArduinoJson.h>
 
 
 AsyncWebSocket ws("/ws");
 AsyncWebServer server(80);
-// broadcast interval (ms) - reduced load by increasing interval
-static const unsigned long BROADCAST_INTERVAL = 2500;
-static unsigned long lastBroadcast = 0;
-// Track last sent child weights to only broadcast on data change (delta mode)
-static std::map<uint8_t, float> lastSentWeights;
+// Weights are pushed when new ESP-NOW data arrives (at most every
+// WS_MIN_PUSH_INTERVAL), plus a heartbeat so online/offline changes show
+static TaskHandle_t pushTask = NULL;
+static unsigned long lastCleanup = 0;
 
+// Push statistics (for /api/ws)
+static uint32_t wsPushes = 0;
+
+static void webPushTask(void *param);
+static void webRequestPush();
+
+// Report the real outcome of a command to the browsers
+static void onCommandResult(uint8_t nodeId, uint8_t cmdType, bool ok, uint32_t rttMs, uint8_t attempts) {
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(128);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "cmdResult");
+  w.field("node", nodeId);
+  w.field("cmd", (cmdType == MSG_TYPE_TARE) ? "tare" : "unknown");
+  w.field("ok", ok);
+  w.field("rtt", rttMs);
+  w.field("attempts", attempts);
+  w.endObject();
+  if (!w.overflow) wsTopicsText(WS_TOPIC_WEIGHTS, buffer);
+}
+
+// Tell the client that asked for a save when it is on flash (storage task)
+static void onStorageAck(uint32_t clientId, const char *item, bool ok) {
+  if (clientId == 0) return;
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(64);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "saved");
+  w.field("item", item);
+  w.field("ok", ok);
+  w.endObject();
+  // by ID: the client may have gone since the request, and async_tcp frees it
+  if (!w.overflow && ws.availableForWrite(clientId)) ws.text(clientId, buffer);
+}
+
+// Streams the weight history (history.h) one node block at a time, so the
+// response never needs more than one block of RAM whatever the node count
+struct HistoryCursor {
+  int nextNode;         // -1 = header not sent yet
+  size_t blockLen;
+  size_t blockPos;
+  uint8_t block[HISTORY_BLOCK_MAX];
+};
+
+static void webSendHistory(AsyncWebServerRequest *request) {
+  std::shared_ptr<HistoryCursor> cursor = std::make_shared<HistoryCursor>();
+  cursor->nextNode = -1;
+  cursor->blockLen = 0;
+  cursor->blockPos = 0;
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/octet-stream",
+    [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      size_t written = 0;
+      while (written < maxLen) {
+        if (cursor->blockPos == cursor->blockLen) {
+          // load the next block, skipping unused rings; 0 bytes ends the response
+          int len = 0;
+          if (cursor->nextNode < 0) {
+            len = historyEncodeHeader(cursor->block, sizeof(cursor->block));
+            cursor->nextNode = 0;
+          }
+          while (len == 0) {
+            len = historyEncodeNode(cursor->nextNode++, cursor->block, sizeof(cursor->block));
+          }
+          if (len < 0) break;
+          cursor->blockLen = len;
+          cursor->blockPos = 0;
+        }
+        size_t n = cursor->blockLen - cursor->blockPos;
+        if (n > maxLen - written) n = maxLen - written;
+        memcpy(buffer + written, cursor->block + cursor->blockPos, n);
+        cursor->blockPos += n;
+        written += n;
+      }
+      return written;
+    });
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
+
+// Weigh-in log as CSV, read from flash a few records per chunk
+static void webSendWeighLog(AsyncWebServerRequest *request) {
+  std::shared_ptr<WeighLogCsvCursor> cursor(weighLogCsvOpen(), weighLogCsvClose);
+  if (!cursor) {
+    request->send(503, "application/json", "{\"error\":\"out of memory\"}");
+    return;
+  }
+  AsyncWebServerResponse *response = request->beginChunkedResponse("text/csv",
+    [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return weighLogCsvRead(cursor.get(), buffer, maxLen);
+    });
+  response->addHeader("Content-Disposition", "attachment; filename=\"weighlog.csv\"");
+  response->addHeader("Cache-Control", "no-store");
+  request->send(response);
+}
 
 void initwebservers(){ 
   ws.onEvent(onEvent);
+  wsBuffersInit();
+  espnowSetCommandResultCallback(onCommandResult);
+  storageSetAckCallback(onStorageAck);
   server.addHandler(&ws);
 
+  // weights go out when the ESP-NOW ingest task has stored something new
+  xTaskCreatePinnedToCore(webPushTask, "wsPush", WS_PUSH_TASK_STACK, NULL,
+                          WS_PUSH_TASK_PRIORITY, &pushTask, WS_PUSH_TASK_CORE);
+  espnowSetDataCallback(webRequestPush);
+
   Serial.println("Starting Web Server");
 
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(LittleFS, "/index.html", "text/html");
-  });
-  server.on("/favicon.png", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(LittleFS, "/favicon.png", "image/png");
-  });
+  // pages, scripts and styles (gzipped, with ETags); see the catch-all below
+  webAssetsInit();
 
   // pitbuttons page
   server.on("/pitbuttons", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(LittleFS, "/pitbuttons/index.html", "text/html");
+    if (!webAssetsSend(request, "/pitbuttons/")) request->send(404, "text/plain", "Not found");
   });
 
-  // Serve static files from pitbuttons directory
-  server.serveStatic("/pitbuttons/", LittleFS, "/pitbuttons/");
-
   // settings endpoints
   server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request){
     String s = settingsAsJson();
@@ -65,12 +171,101 @@ void initwebservers(){
     if (!doc["name2"].isNull()) settingsSetName(2, String((const char*)doc["name2"]));
     if (!doc["color1"].isNull()) settingsSetColor(1, String((const char*)doc["color1"]));
     if (!doc["color2"].isNull()) settingsSetColor(2, String((const char*)doc["color2"]));
+    // written to flash by the storage task, not on this one
     bool ok = settingsSave();
-    if (ok) request->send(200, "application/json", "{\"status\":\"ok\"}"); else request->send(500, "application/json", "{\"error\":\"save failed\"}");
+    if (ok) request->send(202, "application/json", "{\"status\":\"queued\"}"); else request->send(503, "application/json", "{\"error\":\"storage unavailable\"}");
   });
 
+  // node registry with link health, and latency histograms (parent only)
+  if (identityIsParent()) {
+    server.on("/api/nodes", HTTP_GET, [](AsyncWebServerRequest *request){
+      request->send(200, "application/json", nodesAsJson());
+    });
+    server.on("/api/history", HTTP_GET, webSendHistory);
+    server.on("/api/weighlog", HTTP_GET, [](AsyncWebServerRequest *request){
+      JsonDocument doc;
+      doc["records"] = weighLogCount();
+      doc["dropped"] = weighLogDropped();
+      String out;
+      serializeJson(doc, out);
+      request->send(200, "application/json", out);
+    });
+    server.on("/api/weighlog.csv", HTTP_GET, webSendWeighLog);
+    server.on("/api/spec", HTTP_GET, [](AsyncWebServerRequest *request){
+      request->send(200, "application/json", specAsJson());
+    });
+    // POST /api/spec {"classes":[{"name":..,"min":..}],"nodes":{"<id>":<class>}}
+    // Either part may be left out. Children get the change on the next push.
+    server.on("/api/spec", HTTP_POST, [](AsyncWebServerRequest *request){
+      // reply is sent from the body handler
+    }, nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total){
+      if (index != 0 || len != total) { request->send(413, "application/json", "{\"error\":\"body too large\"}"); return; }
+      JsonDocument doc;
+      DeserializationError err = deserializeJson(doc, data, len);
+      if (err) { request->send(400, "application/json", "{\"error\":\"invalid json\"}"); return; }
+      if (doc["classes"].is<JsonArray>()) {
+        SpecClass classes[SPEC_MAX_CLASSES];
+        int count = 0;
+        for (JsonObject obj : doc["classes"].as<JsonArray>()) {
+          if (count >= SPEC_MAX_CLASSES || !obj["min"].is<float>()) {
+            request->send(400, "application/json", "{\"error\":\"invalid classes\"}");
+            return;
+          }
+          strlcpy(classes[count].name, obj["name"] | "", sizeof(classes[count].name));
+          classes[count].minWeight = obj["min"];
+          count++;
+        }
+        if (!specSetClasses(classes, count)) { request->send(400, "application/json", "{\"error\":\"invalid classes\"}"); return; }
+      }
+      for (JsonPair kv : doc["nodes"].as<JsonObject>()) {
+        specSetNodeClass(atoi(kv.key().c_str()), kv.value().as<uint8_t>());
+      }
+      if (specSave()) request->send(200, "application/json", specAsJson()); else request->send(503, "application/json", "{\"error\":\"storage unavailable\"}");
+    });
+    server.on("/api/latency", HTTP_GET, [](AsyncWebServerRequest *request){
+      request->send(200, "application/json", latencyAsJson());
+    });
+    server.on("/api/ws", HTTP_GET, [](AsyncWebServerRequest *request){
+      JsonDocument doc;
+      doc["clients"] = ws.count();
+      doc["pushes"] = wsPushes;
+      doc["skipped"] = wsTopicsSkipped();
+      doc["weights"] = wsTopicsSubscribers(WS_TOPIC_WEIGHTS);
+      doc["lanes"] = wsTopicsSubscribers(WS_TOPIC_LANES);
+      doc["teams"] = wsTopicsSubscribers(WS_TOPIC_TEAMS);
+      doc["nodeHealth"] = wsTopicsSubscribers(WS_TOPIC_HEALTH);
+      String out;
+      serializeJson(doc, out);
+      request->send(200, "application/json", out);
+    });
+    // heap headroom and send-buffer reuse: once the pool is warm,
+    // "allocations" should stay put while "reused" keeps counting
+    server.on("/api/heap", HTTP_GET, [](AsyncWebServerRequest *request){
+      uint32_t freeHeap = ESP.getFreeHeap();
+      size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+      WsBufferStats pool = wsBufferStats();
+      JsonDocument doc;
+      doc["free"] = freeHeap;
+      doc["minFree"] = ESP.getMinFreeHeap();
+      doc["largestBlock"] = largest;
+      doc["fragmentation"] = freeHeap > 0 ? 100 - (uint32_t)((uint64_t)largest * 100 / freeHeap) : 0;
+      JsonObject buffers = doc["wsBuffers"].to<JsonObject>();
+      buffers["inUse"] = pool.inUse;
+      buffers["pooledBytes"] = pool.pooledBytes;
+      buffers["reused"] = pool.reused;
+      buffers["allocations"] = pool.allocations;
+      String out;
+      serializeJson(doc, out);
+      request->send(200, "application/json", out);
+    });
+    server.on("/api/latency/reset", HTTP_POST, [](AsyncWebServerRequest *request){
+      latencyReset();
+      request->send(200, "application/json", "{\"status\":\"ok\"}");
+    });
+  }
+
   // provide a simple HTTP endpoint to tare the scale (child nodes only)
-  if (!ESPNOW_IS_PARENT) {
+  if (!identityIsParent()) {
     server.on("/tare", HTTP_POST, [](AsyncWebServerRequest *request){
       int which = 0;
       if (request->hasArg("scale")) {
@@ -80,128 +275,231 @@ void initwebservers(){
     });
   }
 
-  server.serveStatic("/", LittleFS, "/");
+  // everything else is a static asset ("/" -> /index.html)
+  server.onNotFound([](AsyncWebServerRequest *request) {
+    if (request->method() != HTTP_GET || !webAssetsSend(request, request->url())) {
+      request->send(404, "text/plain", "Not found");
+    }
+  });
   server.begin();
 
   Serial.println("Init Done. Ready");
 }
 
-// Callback helper for building the children JSON object
-static JsonDocument *globalDoc = nullptr;
-static bool dataChanged = false;
-
-static void addChildToJson(uint8_t childId, float weight) {
-  if (globalDoc) {
-    JsonObject children = (*globalDoc)["children"];
-    children[String(childId)] = weight;
-    // Check if this child's weight changed
-    auto it = lastSentWeights.find(childId);
-    if (it == lastSentWeights.end() || it->second != weight) {
-      dataChanged = true;
-      lastSentWeights[childId] = weight;
+// scratch space for draining a child's sample trace and the node registry
+static WeightPoint tracePoints[ESPNOW_TRACE_SIZE];
+static NodeInfo nodeSnapshot[MAX_NODES];
+
+// Receive time of the reading last pushed for each node, so every reading
+// is counted once in the rx -> WebSocket latency histograms
+struct PushedReading {
+  uint8_t id;
+  int64_t rxTime;
+};
+static PushedReading pushedReadings[MAX_NODES];
+
+// True the first time a node's reading (identified by its rx time) is pushed
+static bool webFirstPush(uint8_t id, int64_t rxTime) {
+  int freeSlot = -1;
+  for (int i = 0; i < MAX_NODES; i++) {
+    if (pushedReadings[i].id == id) {
+      if (pushedReadings[i].rxTime == rxTime) return false;
+      pushedReadings[i].rxTime = rxTime;
+      return true;
     }
+    if (pushedReadings[i].id == 0 && freeSlot < 0) freeSlot = i;
   }
+  if (freeSlot < 0) freeSlot = id % MAX_NODES;  // table full: reuse a slot
+  pushedReadings[freeSlot].id = id;
+  pushedReadings[freeSlot].rxTime = rxTime;
+  return true;
 }
 
-// Send current weight to all connected websocket clients as JSON
+// Live weight stream for the parent: one binary frame (weight-frame.h)
+// holding every node in a single snapshot of the registry. Offline nodes
+// stay listed without a weight so the page can grey them out.
+static uint8_t weightFrameBuf[WS_WEIGHT_FRAME_MAX];
+
+static void notifyWeightFrame() {
+  if (wsTopicsSubscribers(WS_TOPIC_WEIGHTS) == 0) return;  // traces keep until someone watches
+  int count = nodesSnapshot(nodeSnapshot, MAX_NODES);
+  uint32_t now = millis();
+  int64_t nowUs = esp_timer_get_time();
+
+  WeightFrameWriter w(weightFrameBuf, sizeof(weightFrameBuf));
+  weightFrameBegin(w, now);
+  for (int i = 0; i < count; i++) {
+    const NodeInfo &node = nodeSnapshot[i];
+    bool online = nodesIsOnline(node, now);
+    if (isnan(node.weight) && online) continue;  // heard from, no reading yet
+
+    // how old the weight is, from the sample instant (time-synced nodes only)
+    int32_t latencyMs = -1;
+    if (node.lastSampleTime != 0) latencyMs = (int32_t)((nowUs - node.lastSampleTime) / 1000);
+    if (node.lastRxTime != 0 && webFirstPush(node.id, node.lastRxTime)) {
+      latencyRecord(LATENCY_RX_TO_WS, nowUs - node.lastRxTime);
+      if (node.lastSampleTime != 0) latencyRecord(LATENCY_SAMPLE_TO_WS, nowUs - node.lastSampleTime);
+    }
+
+    // full-resolution samples received in batch frames since the last push;
+    // only those written are released, the rest stay queued for the next frame
+    size_t room = weightFrameSampleRoom(w);
+    if (room > ESPNOW_TRACE_SIZE) room = ESPNOW_TRACE_SIZE;
+    size_t n = espnowPeekChildTrace(node.id, tracePoints, room);
+    size_t sent = weightFrameAddNode(w, node, online, latencyMs, tracePoints, n);
+    espnowReleaseChildTrace(node.id, sent);
+  }
+  size_t len = weightFrameEnd(w);
+  if (w.overflow) debugln("Weight frame full, some nodes not sent");
+  wsTopicsBinary(WS_TOPIC_WEIGHTS, weightFrameBuf, len);
+  wsPushes++;
+}
+
+// Registry and link stats for "node-health" subscribers (same as /api/nodes)
+static void notifyNodeHealth() {
+  if (wsTopicsSubscribers(WS_TOPIC_HEALTH) == 0) return;
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(NODES_JSON_MAX + 32);
+  MessageWriter w(*buffer);
+  w.beginObject();
+  w.field("type", "nodeHealth");
+  w.key("nodes");
+  nodesWriteJson(w);
+  w.endObject();
+  if (w.overflow) {
+    debugln("Node health message too large, not sent");
+    return;
+  }
+  wsTopicsText(WS_TOPIC_HEALTH, buffer);
+}
+
+// Send current weight to all connected websocket clients
 static void notifyClients(){
+  if (identityIsParent()) {
+    notifyWeightFrame();
+    return;
+  }
+
+  // If child node, just send its own scale data as JSON
   JsonDocument doc;
-  
-  // If parent node, only include child node data from ESP-NOW
-  if (ESPNOW_IS_PARENT) {
-    // Include child node data (add up to 5 child nodes). Each child is
-    // sent as an object { "weight": <value>, "name": "hostname" }
-    // Send children as an array of {id, weight, name} to avoid object key issues
-    JsonArray children = doc["children"].to<JsonArray>();
-    for (uint8_t i = 1; i <= 5; i++) {
-      float childWeight = espnowGetChildWeight(i);
-      if (!isnan(childWeight)) {
-        JsonObject child = children.add<JsonObject>();
-        child["id"] = i;
-        child["weight"] = childWeight;
-        const char* hn = espnowGetChildName(i);
-        if (hn && hn[0] != '\0') child["name"] = hn;
-      }
+  float weight = scaleRead();
+  if (!isnan(weight)) doc["weight"] = weight; else doc["weight"] = nullptr;
+  doc["mode"] = "child";
+  char buf[128];
+  size_t n = serializeJson(doc, buf);
+  wsTopicsText(WS_TOPIC_WEIGHTS, buf, n);
+}
+
+// Push task: sleeps until new data is announced (or the heartbeat runs
+// out), then waits out the rest of WS_MIN_PUSH_INTERVAL so a burst of
+// ESP-NOW frames from several nodes goes out as one WebSocket frame.
+// Only this task builds frames, so the static buffers need no lock.
+static void webPushTask(void *param) {
+  TickType_t lastPush = xTaskGetTickCount();
+  TickType_t lastHealth = lastPush;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WS_HEARTBEAT_INTERVAL));
+
+    TickType_t sinceLast = xTaskGetTickCount() - lastPush;
+    if (sinceLast < pdMS_TO_TICKS(WS_MIN_PUSH_INTERVAL)) {
+      vTaskDelay(pdMS_TO_TICKS(WS_MIN_PUSH_INTERVAL) - sinceLast);
+    }
+    ulTaskNotifyTake(pdTRUE, 0);  // absorb updates that arrived meanwhile
+    lastPush = xTaskGetTickCount();
+
+    notifyClients();
+    if (lastPush - lastHealth >= pdMS_TO_TICKS(WS_HEARTBEAT_INTERVAL)) {
+      lastHealth = lastPush;
+      notifyNodeHealth();
     }
-    
-    doc["mode"] = "parent";
-  } else {
-    // If child node, just send its own scale data
-    float weight = scaleRead();
-    if (!isnan(weight)) doc["weight"] = weight; else doc["weight"] = nullptr;
-    doc["mode"] = "child";
   }
-  
-  char buf[1024];
-  size_t n = serializeJson(doc, buf, sizeof(buf));
-  // log outgoing JSON for debugging (will appear on Serial)
-  // Serial.print("WS OUT: ");
-  // Serial.println(buf);
-  ws.textAll(buf, n);
+}
+
+// Ask the push task for a frame (ESP-NOW ingest task, WebSocket connects)
+static void webRequestPush() {
+  if (pushTask != NULL) xTaskNotifyGive(pushTask);
 }
 
 void webBroadcastLoop(){
+  // pushes happen in webPushTask; just drop clients that went away
   unsigned long now = millis();
-  if (now - lastBroadcast >= BROADCAST_INTERVAL) {
-    lastBroadcast = now;
-    notifyClients();
+  if (now - lastCleanup >= WS_HEARTBEAT_INTERVAL) {
+    lastCleanup = now;
+    ws.cleanupClients();
+  }
+}
+
+// Plain-text tare commands from the scale page
+//   tare                    -> tare every child
+//   tare:nodeId             -> tare one child
+//   tare:child:nodeId       -> same, older form
+static void webHandleTextCommand(const String &msg) {
+  if (!identityIsParent()) {
+    // Child node: only handle local tare commands
+    if (msg == "tare" || msg.startsWith("tare:")) {
+      scaleTare();  // Tare the scale
+      webRequestPush();
+    }
+    return;
+  }
+
+  if (msg == "tare") {
+    // Tare all children heard from so far; results arrive as cmdResult
+    espnowSendTareAll();
+  } else if (msg.startsWith("tare:child:")) {
+    uint8_t nodeId = msg.substring(11).toInt();  // Skip "tare:child:"
+    Serial.print("Sending tare command to node ");
+    Serial.println(nodeId);
+    espnowSendTare(nodeId);
+  } else if (msg.startsWith("tare:")) {
+    uint8_t nodeId = msg.substring(5).toInt();
+    Serial.print("Sending tare command to child node ");
+    Serial.println(nodeId);
+    espnowSendTare(nodeId);
+  } else {
+    debugln("Unknown WS text command: " + msg);
   }
 }
 
 // WebSocket event handler
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len) {
   if (type == WS_EVT_CONNECT) {
+    wsTopicsConnect(client->id());
     // send immediate update when client connects
-    notifyClients();
+    webRequestPush();
+  } else if (type == WS_EVT_DISCONNECT) {
+    wsTopicsDisconnect(client->id());
   } else if (type == WS_EVT_DATA) {
-    // incoming message (assume simple text commands)
-    debugln("OnEvent WS_EVT_Data received");
-    debugln("Data is: " + String((char*)data));
+    // only whole, unfragmented text frames carry commands
+    AwsFrameInfo *info = (AwsFrameInfo*)arg;
+    if (!(info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT)) {
+      debugln("Ignoring fragmented or binary WS frame");
+      return;
+    }
 
-    handleWebSocketMessage(arg, data, len);
-    
-    String msg = String((char*)data).substring(0, len);
-    debugln("WS Received: " + msg);
-    
-    if (ESPNOW_IS_PARENT) {
-      // Parent node: convert simple tare commands to child node commands
-      // tare -> tare all children (not implemented, ignore)
-      // tare:X -> send to child node X, scale 1
-      // tare:child:nodeId -> send to child node
-      // tare:child:nodeId:scale -> send to child node with specific scale
-      
-      if (msg == "tare") {
-        // Tare all - not implemented for parent mode (parent has no local scales)
-        Serial.println("Tare all ignored (parent has no local scales)");
-        notifyClients();
-      } else if (msg.startsWith("tare:child:")) {
-        // Parse: "tare:child:nodeId" or "tare:child:nodeId:scale"
-        String remainder = msg.substring(11);  // Skip "tare:child:"
-        uint8_t nodeId = remainder.toInt(); // Get nodeId from final value after last colon
-        
-        Serial.print("Sending tare command to node ");
-        Serial.println(nodeId);
-        espnowSendTare(nodeId);
-        notifyClients();
-      } else if (msg.startsWith("tare:")) {
-        // Simple format: tare:nodeId -> send to child node with scale 1
-        uint8_t nodeId = msg.substring(5).toInt();
-        Serial.print("Sending tare command to child node ");
-        Serial.print(nodeId);
-        espnowSendTare(nodeId);
-        notifyClients();
+    // JSON messages are parsed once here; anything else is a text command
+    if (len > 0 && data[0] == '{') {
+      JsonDocument doc;
+      DeserializationError error = deserializeJson(doc, (const char*)data, len);
+      if (error) {
+        Serial.print(F("deserializeJson() failed: "));
+        Serial.println(error.f_str());
+        return;
       }
-    } else {
-      // Child node: only handle local tare commands
-      if (msg == "tare") {
-        scaleTare();  // Tare the scale
-        notifyClients();
-      } else if (msg.startsWith("tare:")) {
-        int which = msg.substring(msg.indexOf(':') + 1).toInt();
-        scaleTare();
-        notifyClients();
+      if (doc["type"] == "subscribe") {
+        if (doc["t"].is<long long>()) wallClockFromPage(doc["t"].as<long long>());
+        uint8_t topics = wsTopicsSubscribe(client->id(), doc["topics"].as<JsonArrayConst>());
+        if (topics & WS_TOPIC_WEIGHTS) webRequestPush();
+        if (topics & WS_TOPIC_LANES) notifyButtonClients(client);  // countdowns already running
+        return;
       }
+      handleWebSocketMessage(client, doc);
+      return;
     }
+
+    String msg;
+    msg.concat((const char*)data, len);
+    debugln("WS Received: " + msg);
+    webHandleTextCommand(msg);
   }
 }
 
@@ -217,5 +515,5 @@ void sendCalibrationResult(int which, float value, uint32_t clientId) {
     AsyncWebSocketClient *c = ws.client(clientId);
     if (c) { c->text(buf, n); return; }
   }
-  ws.textAll(buf, n);
+  wsTopicsText(WS_TOPIC_WEIGHTS, buf, n);
 }
\ No newline at end of file
@@ -0,0 +1,419 @@
+#include "weighlog.h"
+#include "config.h"
+#include "sample-ring.h"
+#include "espnow.h"
+#include "wallclock.h"
+#include <LittleFS.h>
+#include <new>
+#include <unistd.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *LOG_PATH = "/weighlog.bin";
+static const char *LOG_OLD_PATH = "/weighlog.old.bin";
+static const char *LOG_TMP_PATH = "/weighlog.tmp";
+static const char *LOG_VFS_PATH = "/littlefs/weighlog.bin";  // LOG_PATH under LittleFS.begin()'s default mount point
+static const size_t HEADER_SIZE = 8;
+static const size_t RECORD_SIZE = sizeof(WeighLogRecord);
+static const size_t RECORD_V1_SIZE = 48;  // version 1: no unixTime
+
+// Ingest task -> writer task
+static SampleRing<WeighLogRecord, WEIGHLOG_QUEUE> logQueue;
+static TaskHandle_t writerTask = NULL;
+
+// Guards the record counts and the file names. The writer appends without
+// it (a reader only reads records already counted, which never change) and
+// takes it to publish new counts or to rotate, remove or repair a file; CSV
+// export takes it only to snapshot the counts, so an export never waits on
+// an append.
+static SemaphoreHandle_t logMutex = NULL;
+
+static uint32_t nextSeq = 0;
+static uint16_t bootNumber = 0;
+static uint32_t currentRecords = 0;   // records in LOG_PATH
+static uint32_t oldRecords = 0;       // records in LOG_OLD_PATH
+static uint32_t rotations = 0;        // lets an export notice a rotation or repair
+
+// Records in a log file, or 0 if it is missing or not a log file.
+// Sets `torn` if the file ends in a partial record.
+static uint32_t weighLogFileRecords(const char *path, bool *torn) {
+  if (torn) *torn = false;
+  File f = LittleFS.open(path, "r");
+  if (!f) return 0;
+  uint8_t header[HEADER_SIZE] = {0};
+  size_t size = f.size();
+  bool valid = f.read(header, HEADER_SIZE) == HEADER_SIZE;
+  f.close();
+  uint32_t magic = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+  uint16_t recordSize = header[6] | (header[7] << 8);
+  if (!valid || magic != WEIGHLOG_MAGIC || recordSize != RECORD_SIZE) {
+    Serial.print("Weigh log: ignoring unreadable ");
+    Serial.println(path);
+    return 0;
+  }
+  if (torn) *torn = (size - HEADER_SIZE) % RECORD_SIZE != 0;
+  return (size - HEADER_SIZE) / RECORD_SIZE;
+}
+
+static bool weighLogReadRecord(const char *path, uint32_t index, WeighLogRecord *record) {
+  File f = LittleFS.open(path, "r");
+  if (!f) return false;
+  bool ok = f.seek(HEADER_SIZE + index * RECORD_SIZE) &&
+            f.read((uint8_t *)record, RECORD_SIZE) == RECORD_SIZE;
+  f.close();
+  return ok;
+}
+
+static bool weighLogWriteHeader(File &f) {
+  uint8_t header[HEADER_SIZE] = {
+    WEIGHLOG_MAGIC & 0xFF, (WEIGHLOG_MAGIC >> 8) & 0xFF, (WEIGHLOG_MAGIC >> 16) & 0xFF, WEIGHLOG_MAGIC >> 24,
+    WEIGHLOG_VERSION & 0xFF, WEIGHLOG_VERSION >> 8,
+    RECORD_SIZE & 0xFF, RECORD_SIZE >> 8
+  };
+  return f.write(header, HEADER_SIZE) == HEADER_SIZE;
+}
+
+// Rewrite a version 1 file as version 2 (unixTime 0, it was never known).
+// Runs at boot before the writer starts; a partial last record is dropped.
+static void weighLogMigrate(const char *path) {
+  File in = LittleFS.open(path, "r");
+  if (!in) return;
+  uint8_t header[HEADER_SIZE] = {0};
+  bool valid = in.read(header, HEADER_SIZE) == HEADER_SIZE;
+  uint32_t magic = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+  uint16_t version = header[4] | (header[5] << 8);
+  uint16_t recordSize = header[6] | (header[7] << 8);
+  if (!valid || magic != WEIGHLOG_MAGIC || version != 1 || recordSize != RECORD_V1_SIZE) {
+    in.close();
+    return;
+  }
+  File out = LittleFS.open(LOG_TMP_PATH, "w");
+  if (!out || !weighLogWriteHeader(out)) {
+    in.close();
+    Serial.println("Weigh log: upgrade failed");
+    return;
+  }
+  uint32_t records = (in.size() - HEADER_SIZE) / RECORD_V1_SIZE;
+  WeighLogRecord record;
+  bool ok = true;
+  for (uint32_t i = 0; i < records && ok; i++) {
+    memset(&record, 0, sizeof(record));
+    ok = in.read((uint8_t *)&record, RECORD_V1_SIZE) == RECORD_V1_SIZE &&
+         out.write((const uint8_t *)&record, RECORD_SIZE) == RECORD_SIZE;
+  }
+  in.close();
+  out.close();
+  if (!ok) {
+    LittleFS.remove(LOG_TMP_PATH);  // keep the old file; it is skipped as unreadable
+    Serial.println("Weigh log: upgrade failed");
+    return;
+  }
+  LittleFS.remove(path);
+  LittleFS.rename(LOG_TMP_PATH, path);
+  Serial.print("Weigh log: upgraded ");
+  Serial.println(path);
+}
+
+// A power cut during an append can leave half a record at the end. Copy
+// the whole records to a new file so later appends stay aligned.
+static void weighLogRepair(uint32_t records) {
+  File in = LittleFS.open(LOG_PATH, "r");
+  File out = LittleFS.open(LOG_TMP_PATH, "w");
+  if (!in || !out || !weighLogWriteHeader(out)) {
+    Serial.println("Weigh log: repair failed");
+    return;
+  }
+  in.seek(HEADER_SIZE);
+  WeighLogRecord record;
+  for (uint32_t i = 0; i < records; i++) {
+    if (in.read((uint8_t *)&record, RECORD_SIZE) != RECORD_SIZE) break;
+    out.write((const uint8_t *)&record, RECORD_SIZE);
+  }
+  in.close();
+  out.close();
+  LittleFS.remove(LOG_PATH);
+  LittleFS.rename(LOG_TMP_PATH, LOG_PATH);
+  Serial.println("Weigh log: dropped a partial record");
+}
+
+// Current file is full: it becomes the previous generation. Caller holds logMutex.
+static void weighLogRotate() {
+  LittleFS.remove(LOG_OLD_PATH);
+  LittleFS.rename(LOG_PATH, LOG_OLD_PATH);
+  oldRecords = currentRecords;
+  currentRecords = 0;
+  rotations++;
+}
+
+// Append everything queued in one open/write/close (writer task only;
+// only this task changes currentRecords, so it may read it unlocked)
+static void weighLogFlush() {
+  while (!logQueue.empty()) {
+    if (currentRecords >= WEIGHLOG_FILE_RECORDS) {
+      xSemaphoreTake(logMutex, portMAX_DELAY);
+      weighLogRotate();
+      xSemaphoreGive(logMutex);
+    }
+
+    File f = LittleFS.open(LOG_PATH, "a");
+    if (!f) {
+      Serial.println("Weigh log: cannot open log file");
+      return;
+    }
+    if (f.size() == 0 && !weighLogWriteHeader(f)) {
+      f.close();
+      LittleFS.remove(LOG_PATH);  // no half header for the next append to follow
+      Serial.println("Weigh log: write failed");
+      return;
+    }
+    uint32_t written = 0;
+    bool failed = false;
+    WeighLogRecord *record;
+    while (currentRecords + written < WEIGHLOG_FILE_RECORDS && (record = logQueue.peek()) != nullptr) {
+      if (f.write((const uint8_t *)record, RECORD_SIZE) != RECORD_SIZE) {
+        failed = true;
+        break;
+      }
+      logQueue.releasePop();
+      written++;
+    }
+    f.close();
+
+    // publish the records once they are on flash
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    currentRecords += written;
+    if (failed) {
+      Serial.println("Weigh log: write failed (flash full?)");
+      // cut off the partial record so the next append stays aligned
+      if (truncate(LOG_VFS_PATH, HEADER_SIZE + currentRecords * RECORD_SIZE) != 0) {
+        weighLogRepair(currentRecords);
+        rotations++;  // the current file was replaced under any export
+      }
+    }
+    xSemaphoreGive(logMutex);
+    if (failed) return;
+  }
+}
+
+// Writer: wake on the first queued record, then wait WEIGHLOG_FLUSH_DELAY
+// so weigh-ins arriving together share one flash write
+static void weighLogTask(void *param) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    vTaskDelay(pdMS_TO_TICKS(WEIGHLOG_FLUSH_DELAY));
+    weighLogFlush();
+  }
+}
+
+void weighLogInit() {
+  if (logMutex == NULL) logMutex = xSemaphoreCreateMutex();
+
+  weighLogMigrate(LOG_PATH);
+  weighLogMigrate(LOG_OLD_PATH);
+
+  bool torn = false;
+  currentRecords = weighLogFileRecords(LOG_PATH, &torn);
+  if (torn) weighLogRepair(currentRecords);
+  oldRecords = weighLogFileRecords(LOG_OLD_PATH, nullptr);
+  if (currentRecords == 0 && LittleFS.exists(LOG_PATH)) {
+    // empty, or not a log file we can append to
+    LittleFS.remove(LOG_PATH);
+  }
+
+  // carry the sequence on from the newest record
+  WeighLogRecord last;
+  bool haveLast = (currentRecords > 0 && weighLogReadRecord(LOG_PATH, currentRecords - 1, &last)) ||
+                  (oldRecords > 0 && weighLogReadRecord(LOG_OLD_PATH, oldRecords - 1, &last));
+  if (haveLast) {
+    nextSeq = last.seq + 1;
+    bootNumber = last.boot + 1;
+  }
+
+  Serial.print("Weigh log: ");
+  Serial.print(currentRecords + oldRecords);
+  Serial.print(" records, boot ");
+  Serial.println(bootNumber);
+
+  if (writerTask == NULL) {
+    xTaskCreatePinnedToCore(weighLogTask, "weighLog", WEIGHLOG_TASK_STACK, NULL,
+                            WEIGHLOG_TASK_PRIORITY, &writerTask, WEIGHLOG_TASK_CORE);
+  }
+}
+
+void weighLogAdd(uint8_t node, float weight, const SpecClass *spec, uint8_t specClass,
+                 SpecVerdict verdict) {
+  if (writerTask == NULL || isnan(weight)) return;
+  WeighLogRecord *record = logQueue.beginPush();
+  if (record == nullptr) return;  // counted as dropped by the ring
+
+  memset(record, 0, sizeof(*record));
+  record->seq = nextSeq++;
+  record->boot = bootNumber;
+  record->node = node;
+  record->uptimeMs = millis();
+  record->unixTime = wallClockNow();
+  record->weight = (int32_t)lroundf(weight * ESPNOW_WEIGHT_SCALE);
+  if (spec != nullptr && verdict != SPEC_VERDICT_NONE) {
+    record->flags |= WEIGHLOG_HAS_SPEC;
+    record->spec = (int32_t)lroundf(spec->minWeight * ESPNOW_WEIGHT_SCALE);
+    record->specClass = specClass;
+    if (verdict == SPEC_VERDICT_PASS) record->flags |= WEIGHLOG_PASS;
+  }
+  char name[NODE_NAME_LEN + 1] = "";
+  nodesGetName(node, name);
+  memcpy(record->name, name, NODE_NAME_LEN);
+  logQueue.commitPush();
+  xTaskNotifyGive(writerTask);
+}
+
+uint32_t weighLogCount() {
+  return currentRecords + oldRecords;
+}
+
+uint32_t weighLogDropped() {
+  return logQueue.dropped();
+}
+
+// CSV export: walks the previous file then the current one, a few records
+// per file access. If the files rotate mid-export it starts over and skips
+// by sequence number, so no record is sent twice.
+#define CSV_BATCH 8
+#define CSV_LINE_MAX 160
+
+struct WeighLogCsvCursor {
+  uint8_t file;           // 0 = previous generation, 1 = current, 2 = done
+  uint32_t index;         // next record in that file
+  uint32_t rotations;     // value of `rotations` when file/index were set
+  bool headerSent;
+  bool anySent;
+  uint32_t lastSeq;       // newest record already sent
+  WeighLogRecord batch[CSV_BATCH];
+  uint8_t batchLen;
+  uint8_t batchPos;
+  char line[CSV_LINE_MAX];
+  size_t lineLen;
+  size_t linePos;
+};
+
+WeighLogCsvCursor *weighLogCsvOpen() {
+  WeighLogCsvCursor *cursor = new (std::nothrow) WeighLogCsvCursor();
+  if (cursor != nullptr) cursor->rotations = rotations;
+  return cursor;
+}
+
+void weighLogCsvClose(WeighLogCsvCursor *cursor) {
+  delete cursor;
+}
+
+// Read the next few records of the export, given the record counts of both files
+static bool weighLogCsvReadBatch(WeighLogCsvCursor *c, const uint32_t counts[2]) {
+  c->batchLen = 0;
+  while (c->batchLen == 0 && c->file < 2) {
+    const char *path = c->file == 0 ? LOG_OLD_PATH : LOG_PATH;
+    uint32_t records = counts[c->file];
+    if (c->index >= records) {
+      c->file++;
+      c->index = 0;
+      continue;
+    }
+    File f = LittleFS.open(path, "r");
+    if (!f || !f.seek(HEADER_SIZE + c->index * RECORD_SIZE)) {
+      c->file++;
+      c->index = 0;
+      continue;
+    }
+    while (c->batchLen < CSV_BATCH && c->index < records &&
+           f.read((uint8_t *)&c->batch[c->batchLen], RECORD_SIZE) == RECORD_SIZE) {
+      c->index++;
+      c->batchLen++;
+    }
+    f.close();
+    if (c->batchLen == 0) {
+      c->file++;
+      c->index = 0;
+    }
+  }
+  return c->batchLen > 0;
+}
+
+// Refill the record batch; false when there is nothing left. The counts are
+// snapshotted under logMutex and the records read without it; a batch read
+// across a rotation or repair is thrown away and the export starts over.
+static bool weighLogCsvFetch(WeighLogCsvCursor *c) {
+  c->batchPos = 0;
+  for (;;) {
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    if (c->rotations != rotations) {
+      // files moved under us: start again, the seq check skips what was sent
+      c->file = 0;
+      c->index = 0;
+      c->rotations = rotations;
+    }
+    uint32_t counts[2] = {oldRecords, currentRecords};
+    xSemaphoreGive(logMutex);
+
+    bool more = weighLogCsvReadBatch(c, counts);
+
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    bool moved = c->rotations != rotations;
+    xSemaphoreGive(logMutex);
+    if (!moved) return more;
+  }
+}
+
+static size_t weighLogCsvFormat(const WeighLogRecord &r, char *out, size_t cap) {
+  char name[NODE_NAME_LEN + 1];
+  memcpy(name, r.name, NODE_NAME_LEN);
+  name[NODE_NAME_LEN] = '\0';
+  for (char *p = name; *p; p++) {
+    if (*p == ',' || *p == '"' || *p == '\n' || *p == '\r') *p = ' ';
+  }
+  char spec[16] = "";
+  char specClass[4] = "";
+  const char *result = "";
+  if (r.flags & WEIGHLOG_HAS_SPEC) {
+    snprintf(spec, sizeof(spec), "%.2f", r.spec / ESPNOW_WEIGHT_SCALE);
+    snprintf(specClass, sizeof(specClass), "%u", r.specClass);
+    result = (r.flags & WEIGHLOG_PASS) ? "PASS" : "FAIL";
+  }
+  char when[24] = "";  // empty when the clock was not set
+  if (r.unixTime != 0) {
+    time_t t = r.unixTime;
+    struct tm utc;
+    gmtime_r(&t, &utc);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  }
+  int n = snprintf(out, cap, "%lu,%u,%lu,%s,%u,%s,%.2f,%s,%s,%s\r\n",
+                   (unsigned long)r.seq, r.boot, (unsigned long)r.uptimeMs, when, r.node,
+                   name, r.weight / ESPNOW_WEIGHT_SCALE, specClass, spec, result);
+  if (n < 0) return 0;
+  return (size_t)n < cap ? (size_t)n : cap - 1;
+}
+
+size_t weighLogCsvRead(WeighLogCsvCursor *c, uint8_t *buffer, size_t maxLen) {
+  size_t written = 0;
+  while (written < maxLen) {
+    if (c->linePos == c->lineLen) {
+      // next line: the column header, then one line per record
+      if (!c->headerSent) {
+        c->headerSent = true;
+        c->lineLen = snprintf(c->line, sizeof(c->line), "seq,boot,uptime_ms,time_utc,node,name,weight_g,spec_class,spec_g,result\r\n");
+      } else {
+        if (c->batchPos == c->batchLen && !weighLogCsvFetch(c)) break;
+        const WeighLogRecord &record = c->batch[c->batchPos++];
+        if (c->anySent && record.seq <= c->lastSeq) continue;
+        c->anySent = true;
+        c->lastSeq = record.seq;
+        c->lineLen = weighLogCsvFormat(record, c->line, sizeof(c->line));
+      }
+      c->linePos = 0;
+    }
+    size_t n = c->lineLen - c->linePos;
+    if (n > maxLen - written) n = maxLen - written;
+    memcpy(buffer + written, c->line + c->linePos, n);
+    c->linePos += n;
+    written += n;
+  }
+  return written;
+}
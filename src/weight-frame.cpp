@@ -0,0 +1,81 @@
+#include "weight-frame.h"
+#include "spec.h"
+#include "battery.h"
+
+// offset of the node count within the header
+static const size_t NODE_COUNT_OFFSET = 6;
+
+// per-node bytes before the samples, worst case
+static const size_t NODE_FIXED_MAX = 1 + 1 + 4 + 4 + 1 + 2 + 2 + 1 + 1 + NODE_NAME_LEN + 2 + 4;
+
+static int32_t weightFrameGrams(float grams) {
+  return (int32_t)lroundf(grams * ESPNOW_WEIGHT_SCALE);
+}
+
+void weightFrameBegin(WeightFrameWriter &w, uint32_t parentNow) {
+  w.put8(WEIGHT_FRAME_MAGIC);
+  w.put8(WEIGHT_FRAME_VERSION);
+  w.put32(parentNow);
+  w.put8(0);  // node count
+}
+
+size_t weightFrameAddNode(WeightFrameWriter &w, const NodeInfo &node, bool online,
+                          int32_t latencyMs, const WeightPoint *samples, size_t sampleCount) {
+  if (!w.fits(NODE_FIXED_MAX)) {
+    w.overflow = true;
+    return 0;  // keep the frame well formed: skip the whole node
+  }
+  w.buf[NODE_COUNT_OFFSET]++;
+
+  uint8_t flags = 0;
+  bool hasWeight = online && !isnan(node.weight);
+  bool hasSettled = online && !isnan(node.settledWeight);
+  if (online) flags |= WF_ONLINE;
+  if (hasWeight) flags |= WF_HAS_WEIGHT;
+  if (hasSettled) flags |= WF_HAS_SETTLED;
+  if (hasSettled && node.verdict != SPEC_VERDICT_NONE) flags |= WF_HAS_VERDICT;
+  if (hasSettled && node.verdict == SPEC_VERDICT_PASS) flags |= WF_PASS;
+  if (node.clockSynced) flags |= WF_SYNCED;
+  if (node.rssi != 0) flags |= WF_HAS_RSSI;
+  if (latencyMs >= 0) flags |= WF_HAS_LATENCY;
+
+  w.put8(node.id);
+  w.put8(flags);
+  if (hasWeight) w.put32((uint32_t)weightFrameGrams(node.weight));
+  if (hasSettled) w.put32((uint32_t)weightFrameGrams(node.settledWeight));
+  if (flags & WF_HAS_RSSI) w.put8((uint8_t)node.rssi);
+  if (flags & WF_HAS_LATENCY) w.put16(latencyMs > 0xFFFF ? 0xFFFF : (uint16_t)latencyMs);
+  w.put16(node.lossCount > 0xFFFF ? 0xFFFF : (uint16_t)node.lossCount);
+  if (node.batteryMv == 0) w.put8(WF_BATTERY_UNKNOWN);
+  else if (node.batterySoc == BATTERY_SOC_EXTERNAL) w.put8(WF_BATTERY_EXTERNAL);
+  else w.put8((uint8_t)node.batterySoc);
+  size_t nameLen = strnlen(node.name, NODE_NAME_LEN);
+  w.put8((uint8_t)nameLen);
+  w.putBytes(node.name, nameLen);
+
+  // as many samples as fit, all within a 16-bit offset of the first
+  size_t n = 0;
+  if (sampleCount > 0) {
+    size_t room = (w.cap - w.len - 2 - 4) / 6;
+    while (n < sampleCount && n < room &&
+           samples[n].timestamp - samples[0].timestamp <= 0xFFFF) n++;
+    if (n < sampleCount) w.overflow = true;
+  }
+  w.put16((uint16_t)n);
+  if (n == 0) return 0;
+  w.put32(samples[0].timestamp);
+  for (size_t i = 0; i < n; i++) {
+    w.put16((uint16_t)(samples[i].timestamp - samples[0].timestamp));
+    w.put32((uint32_t)weightFrameGrams(samples[i].weight));
+  }
+  return n;
+}
+
+size_t weightFrameSampleRoom(const WeightFrameWriter &w) {
+  if (!w.fits(NODE_FIXED_MAX)) return 0;
+  return (w.cap - w.len - NODE_FIXED_MAX) / 6;
+}
+
+size_t weightFrameEnd(WeightFrameWriter &w) {
+  return w.len;
+}
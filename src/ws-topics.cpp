@@ -0,0 +1,204 @@
+#include "ws-topics.h"
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include <atomic>
+
+extern AsyncWebSocket ws;  // webpage.cpp
+
+// Subscription table: client ID -> topic mask. Written from the async_tcp
+// task (connect, disconnect, subscribe), read by the push task and loop().
+// Senders work from this table and address clients by ID, never walking
+// the library's client list, which only the async_tcp task may touch.
+struct TopicClient {
+  uint32_t id;    // 0 = free entry
+  uint8_t topics;
+};
+static TopicClient topicClients[WS_TOPICS_MAX_CLIENTS];
+static portMUX_TYPE topicsMux = portMUX_INITIALIZER_UNLOCKED;
+static std::atomic<uint32_t> skipped{0};  // bumped by every task that sends
+
+// Send buffer pool; an entry with use_count() == 1 is held only here
+static AsyncWebSocketSharedBuffer bufferPool[WS_BUFFER_POOL];
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t buffersReused = 0;
+static uint32_t bufferAllocations = 0;
+
+static const struct {
+  const char *name;
+  uint8_t topic;
+} TOPIC_NAMES[] = {
+  { "weights", WS_TOPIC_WEIGHTS },
+  { "lanes", WS_TOPIC_LANES },
+  { "teams", WS_TOPIC_TEAMS },
+  { "node-health", WS_TOPIC_HEALTH },
+};
+
+// IDs of the connected clients subscribed to a topic; returns the count
+static int wsTopicsClients(uint8_t topic, uint32_t *ids) {
+  int count = 0;
+  portENTER_CRITICAL(&topicsMux);
+  for (int i = 0; i < WS_TOPICS_MAX_CLIENTS; i++) {
+    if (topicClients[i].id != 0 && (topicClients[i].topics & topic)) {
+      if (ids) ids[count] = topicClients[i].id;
+      count++;
+    }
+  }
+  portEXIT_CRITICAL(&topicsMux);
+  return count;
+}
+
+void wsTopicsConnect(uint32_t clientId) {
+  portENTER_CRITICAL(&topicsMux);
+  int freeEntry = -1;
+  for (int i = 0; i < WS_TOPICS_MAX_CLIENTS; i++) {
+    if (topicClients[i].id == clientId) { freeEntry = i; break; }
+    if (topicClients[i].id == 0 && freeEntry < 0) freeEntry = i;
+  }
+  if (freeEntry >= 0) {
+    topicClients[freeEntry].id = clientId;
+    topicClients[freeEntry].topics = WS_TOPIC_ALL;
+  }
+  portEXIT_CRITICAL(&topicsMux);
+  if (freeEntry < 0) Serial.println("WS topics: client table full, client gets no pushes");
+}
+
+void wsTopicsDisconnect(uint32_t clientId) {
+  portENTER_CRITICAL(&topicsMux);
+  for (int i = 0; i < WS_TOPICS_MAX_CLIENTS; i++) {
+    if (topicClients[i].id == clientId) topicClients[i].id = 0;
+  }
+  portEXIT_CRITICAL(&topicsMux);
+}
+
+uint8_t wsTopicsSubscribe(uint32_t clientId, JsonArrayConst topics) {
+  uint8_t mask = 0;
+  for (JsonVariantConst name : topics) {
+    const char *str = name.as<const char *>();
+    if (str == nullptr) continue;
+    for (const auto &entry : TOPIC_NAMES) {
+      if (strcmp(str, entry.name) == 0) mask |= entry.topic;
+    }
+  }
+
+  bool stored = false;
+  portENTER_CRITICAL(&topicsMux);
+  for (int i = 0; i < WS_TOPICS_MAX_CLIENTS; i++) {
+    if (topicClients[i].id == clientId) {
+      topicClients[i].topics = mask;
+      stored = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&topicsMux);
+  if (!stored) Serial.println("WS topics: no room to store a subscription");
+  return mask;
+}
+
+int wsTopicsSubscribers(uint8_t topic) {
+  return wsTopicsClients(topic, nullptr);
+}
+
+void wsBuffersInit() {
+  for (int i = 0; i < WS_BUFFER_POOL; i++) {
+    if (bufferPool[i]) continue;
+    bufferPool[i] = std::make_shared<std::vector<uint8_t>>();
+    bufferPool[i]->reserve(WS_BUFFER_SIZE);
+  }
+}
+
+AsyncWebSocketSharedBuffer wsBufferClaim(size_t capacity) {
+  // smallest free buffer that fits, else the largest free one (grown below)
+  AsyncWebSocketSharedBuffer buffer;
+  size_t pooledBytes = 0;
+  portENTER_CRITICAL(&poolMux);
+  int best = -1;
+  for (int i = 0; i < WS_BUFFER_POOL; i++) {
+    if (bufferPool[i]) pooledBytes += bufferPool[i]->capacity();
+    if (!bufferPool[i] || bufferPool[i].use_count() != 1) continue;
+    if (best < 0) { best = i; continue; }
+    size_t have = bufferPool[i]->capacity(), bestHave = bufferPool[best]->capacity();
+    bool fits = have >= capacity, bestFits = bestHave >= capacity;
+    if (fits ? (!bestFits || have < bestHave) : (!bestFits && have > bestHave)) best = i;
+  }
+  if (best >= 0) buffer = bufferPool[best];
+  portEXIT_CRITICAL(&poolMux);
+
+  // growing the buffer would take the pool past its budget: put it back to
+  // its starting size instead, and serve this claim from the heap
+  bool overBudget = buffer && buffer->capacity() < capacity &&
+                    pooledBytes - buffer->capacity() + capacity > WS_BUFFER_POOL_BYTES;
+  if (overBudget && buffer->capacity() > WS_BUFFER_SIZE) {
+    std::vector<uint8_t>().swap(*buffer);
+    buffer->reserve(WS_BUFFER_SIZE);
+  }
+
+  bool allocated = true;
+  if (!buffer || overBudget || (buffer->capacity() < capacity && capacity > WS_BUFFER_MAX)) {
+    buffer = std::make_shared<std::vector<uint8_t>>();  // pool busy, or too big to keep
+    buffer->reserve(capacity);
+  } else {
+    buffer->clear();
+    if (buffer->capacity() < capacity) buffer->reserve(capacity);  // stays this size in the pool
+    else allocated = false;
+  }
+
+  portENTER_CRITICAL(&poolMux);
+  if (allocated) bufferAllocations++; else buffersReused++;
+  portEXIT_CRITICAL(&poolMux);
+  return buffer;
+}
+
+WsBufferStats wsBufferStats() {
+  WsBufferStats stats = { 0, 0, buffersReused, bufferAllocations };
+  portENTER_CRITICAL(&poolMux);
+  for (int i = 0; i < WS_BUFFER_POOL; i++) {
+    if (!bufferPool[i]) continue;
+    if (bufferPool[i].use_count() > 1) stats.inUse++;
+    stats.pooledBytes += bufferPool[i]->capacity();
+  }
+  portEXIT_CRITICAL(&poolMux);
+  return stats;
+}
+
+// Queue a shared buffer to every connected subscriber of the topic
+static void wsTopicsSendBuffer(uint8_t topic, const AsyncWebSocketSharedBuffer &buffer, bool binary) {
+  uint32_t ids[WS_TOPICS_MAX_CLIENTS];
+  int count = wsTopicsClients(topic, ids);
+  for (int i = 0; i < count; i++) {
+    if (!ws.availableForWrite(ids[i])) {
+      // slow client: drop this message rather than letting the library
+      // disconnect it; the next one carries the current state anyway
+      skipped++;
+      continue;
+    }
+    if (binary) ws.binary(ids[i], buffer); else ws.text(ids[i], buffer);
+  }
+}
+
+static void wsTopicsSend(uint8_t topic, const uint8_t *data, size_t len, bool binary) {
+  if (wsTopicsSubscribers(topic) == 0) return;
+  AsyncWebSocketSharedBuffer buffer = wsBufferClaim(len);
+  buffer->assign(data, data + len);
+  wsTopicsSendBuffer(topic, buffer, binary);
+}
+
+void wsTopicsText(uint8_t topic, AsyncWebSocketSharedBuffer buffer) {
+  if (wsTopicsSubscribers(topic) == 0) return;
+  wsTopicsSendBuffer(topic, buffer, false);
+}
+
+void wsTopicsText(uint8_t topic, const char *message, size_t len) {
+  wsTopicsSend(topic, (const uint8_t *)message, len, false);
+}
+
+void wsTopicsText(uint8_t topic, const String &message) {
+  wsTopicsSend(topic, (const uint8_t *)message.c_str(), message.length(), false);
+}
+
+void wsTopicsBinary(uint8_t topic, const uint8_t *data, size_t len) {
+  wsTopicsSend(topic, data, len, true);
+}
+
+uint32_t wsTopicsSkipped() {
+  return skipped;
+}